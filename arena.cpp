@@ -0,0 +1,73 @@
+#include "renderer.hpp"
+
+// blocks start at this size and at least double when one runs out
+static const size_t MIN_BLOCK_SIZE = 64 * 1024;
+
+void* FrameArena::allocateBytes(size_t bytes, size_t alignment) {
+  while (true) {
+    if (block < blocks.size()) {
+      uintptr_t start = (uintptr_t)blocks[block].get() + offset;
+      size_t padding = (alignment - start % alignment) % alignment;
+      if (offset + padding + bytes <= blockSizes[block]) {
+        offset += padding + bytes;
+        used += padding + bytes;
+        highWater = std::max(highWater, used);
+        return (void*)(start + padding);
+      }
+      if (block + 1 < blocks.size()) {
+        block++;
+        offset = 0;
+        continue;
+      }
+    }
+    size_t size = std::max(MIN_BLOCK_SIZE, bytes + alignment);
+    if (!blockSizes.empty()) size = std::max(size, blockSizes.back() * 2);
+    blocks.emplace_back(new char[size]);
+    blockSizes.push_back(size);
+    block = blocks.size() - 1;
+    offset = 0;
+  }
+}
+
+FrameArena::Mark FrameArena::getMark() const {
+  return Mark{ block, offset, used };
+}
+
+void FrameArena::rewind(const Mark& mark) {
+  block = mark.block;
+  offset = mark.offset;
+  used = mark.used;
+}
+
+// gives back everything at once, nothing allocated from the arena may be used after
+void FrameArena::reset() {
+  if (blocks.size() > 1) {
+    size_t total = 0;
+    for (size_t size : blockSizes) total += size;
+    blocks.clear();
+    blockSizes.clear();
+    blocks.emplace_back(new char[total]);
+    blockSizes.push_back(total);
+  }
+  block = 0;
+  offset = 0;
+  used = 0;
+}
+
+size_t FrameArena::getUsed() const {
+  return used;
+}
+
+size_t FrameArena::getHighWater() const {
+  return highWater;
+}
+
+void FrameArena::resetHighWater() {
+  highWater = used;
+}
+
+size_t FrameArena::getCapacity() const {
+  size_t total = 0;
+  for (size_t size : blockSizes) total += size;
+  return total;
+}
@@ -0,0 +1,155 @@
+#include "renderer.hpp"
+
+// letters from emptiest to densest, for how bright a cell is in an image
+static const std::string densityRamp = " .'`^\",:;Il!i><~+_-?][}{1)(|\\/tfjrxnuvczXYUJCLQ0OZmwqpdbkhao*#MW&8%B@$";
+
+bool getBatchFormat(const std::string& name, BatchFormat& format) {
+  if (name == "cells") format = BATCH_CELLS;
+  else if (name == "ansi") format = BATCH_ANSI;
+  else if (name == "ppm") format = BATCH_PPM;
+  else return false;
+  return true;
+}
+
+// the number in a colour's escape code ( "\033[36m" is 36 ), 0 for the default colour
+static unsigned char getSgrNumber(unsigned char colour) {
+  const std::string& code = getColourCode(colour);
+  int number = 0;
+  for (char c : code) {
+    if (c >= '0' && c <= '9') number = number * 10 + c - '0';
+  }
+  return std::min(number, 255);
+}
+
+// the colour of an sgr number, white for the default and anything else
+static std::array<float, 3> getSgrColour(int number) {
+  static const std::array<float, 3> colours[8] = {
+    { 0.3f, 0.3f, 0.3f }, { 0.8f, 0.1f, 0.1f }, { 0.1f, 0.8f, 0.1f }, { 0.8f, 0.8f, 0.1f },
+    { 0.2f, 0.3f, 0.9f }, { 0.8f, 0.1f, 0.8f }, { 0.1f, 0.8f, 0.8f }, { 0.9f, 0.9f, 0.9f },
+  };
+  if (number >= 30 && number <= 37) return colours[number - 30];
+  if (number >= 90 && number <= 97) {
+    std::array<float, 3> colour = colours[number - 90];
+    for (float& channel : colour) channel = std::min(1.0f, channel * 1.25f);
+    return colour;
+  }
+  return { 1, 1, 1 };
+}
+
+// turns a frame into the bytes of a format. ansi frames depend on the frame before, so frames have
+// to come in order
+class BatchWriter {
+public:
+  BatchWriter(BatchFormat batchFormat) {
+    format = batchFormat;
+    for (int i = 0; i < 256; ++i) {
+      size_t index = densityRamp.find((char)i);
+      brightness[i] = index == std::string::npos ? 0.5f : (float)index / (densityRamp.size() - 1);
+    }
+  }
+
+  const std::string& write(const Screen& screen) {
+    if (format == BATCH_ANSI) return encoder.encode(screen);
+    output.clear();
+    if (format == BATCH_CELLS) {
+      for (const Cell& cell : screen.buffer) {
+        output += cell.letter;
+        output += (char)getSgrNumber(cell.colour);
+      }
+      return output;
+    }
+
+    output.reserve(32 + screen.width * screen.height * 6); // appending a row to itself mustn't reallocate
+    output += "P6\n" + std::to_string(screen.width) + " " + std::to_string(screen.height * 2) + "\n255\n";
+    for (int row = 0; row < screen.height; ++row) {
+      size_t rowStart = output.size();
+      for (int column = 0; column < screen.width; ++column) {
+        const Cell& cell = screen.buffer[row * screen.width + column];
+        std::array<float, 3> colour = getSgrColour(getSgrNumber(cell.colour));
+        for (float channel : colour) output += (char)(unsigned char)std::lround(channel * brightness[(unsigned char)cell.letter] * 255);
+      }
+      output.append(output, rowStart, output.size() - rowStart); // cells are about twice as tall as wide
+    }
+    return output;
+  }
+
+private:
+  BatchFormat format;
+  FrameEncoder encoder;
+  std::string output;
+  std::array<float, 256> brightness;
+};
+
+// a finished frame waiting to be written, frame f waits in slot f % the number of slots
+struct BatchSlot {
+  std::vector<Cell> cells;
+  int frame = -1;
+};
+
+// draws every frame of a timeline and writes them in order. each thread has its own copy of the scene,
+// a renderer and a screen, poses its copy for whichever frame is next and hands the cells over to be
+// written, so frames are drawn in parallel but come out the same whatever the thread count.
+// a thread can get at most a few frames ahead of the one being written
+BatchStats renderBatch(const Scene& scene, const Timeline& timeline, int width, int height, int threadCount, BatchFormat format, std::ostream& output) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  threadCount = std::max(1, threadCount);
+  int frameCount = std::max(0, timeline.frameCount);
+  std::vector<BatchSlot> slots(threadCount * 2);
+  for (BatchSlot& slot : slots) slot.cells.assign(width * height, Cell{ ' ', 0 });
+  std::atomic<int> nextFrame(0);
+  int written = 0;
+  bool stopping = false;
+  std::mutex mutex;
+  std::condition_variable changed;
+
+  auto drawFrames = [&]() {
+    Scene posed = scene;
+    Renderer renderer(1);
+    Screen screen(width, height);
+    int frame;
+    while ((frame = nextFrame++) < frameCount) {
+      posed.pose(scene, timeline, frame);
+      posed.draw(renderer, screen);
+      renderer.profiler.endFrame();
+
+      BatchSlot& slot = slots[frame % slots.size()];
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [&]() { return stopping || written > frame - (int)slots.size(); });
+      if (stopping) return;
+      slot.cells.swap(screen.buffer);
+      slot.frame = frame;
+      changed.notify_all();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < threadCount; ++i) threads.emplace_back(drawFrames);
+
+  BatchWriter writer(format);
+  Screen screen(width, height);
+  BatchStats stats = { 0, 0, 0 };
+  for (int frame = 0; frame < frameCount; ++frame) {
+    BatchSlot& slot = slots[frame % slots.size()];
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [&]() { return slot.frame == frame; });
+      screen.buffer.swap(slot.cells);
+      written = frame + 1;
+      changed.notify_all();
+    }
+    const std::string& bytes = writer.write(screen);
+    output.write(bytes.data(), bytes.size());
+    if (!output) break;
+    stats.frames++;
+    stats.bytes += bytes.size();
+  }
+  output.flush();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  for (std::thread& thread : threads) thread.join();
+  stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return stats;
+}
@@ -0,0 +1,818 @@
+#include <chrono>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <new>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "renderer.hpp"
+
+// renders fixed scenes into an in-memory screen, with no terminal output and no frame rate sleep,
+// and reports how long each stage took. every frame is hashed so a faster build can be checked
+// against a slower one.
+
+struct BenchScene {
+  std::string name;
+  Scene (*make)();
+};
+
+static const BenchScene benchScenes[] = {
+  { "demo", makeDemoScene },
+  { "closeup", makeCloseUpScene },
+  { "manycubes", makeManyCubesScene },
+  { "mostlystatic", makeMostlyStaticScene },
+  { "instances", makeInstancesScene },
+  { "largemesh", makeLargeMeshScene },
+  { "lod", makeLodScene },
+};
+
+// every allocation in the program is counted, so --check can show that frames do not allocate
+static std::atomic<long long> allocationCount(0);
+
+void* operator new(size_t size) {
+  allocationCount++;
+  void* memory = std::malloc(size ? size : 1);
+  if (!memory) throw std::bad_alloc();
+  return memory;
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  allocationCount++;
+  size_t aligned = ((size ? size : 1) + (size_t)alignment - 1) / (size_t)alignment * (size_t)alignment;
+  void* memory = std::aligned_alloc((size_t)alignment, aligned);
+  if (!memory) throw std::bad_alloc();
+  return memory;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+
+// every new above comes from malloc or aligned_alloc, both given back with free, but gcc sees free
+// called on what operator new returned once these are inlined and warns that they don't match
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept {
+  std::free(memory);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static double getMilliseconds(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// nearest rank percentile
+static double getPercentile(std::vector<double> values, double percent) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  int rank = std::ceil(percent / 100 * values.size());
+  return values[std::max(0, std::min(rank - 1, (int)values.size() - 1))];
+}
+
+static void printStage(std::string name, const std::vector<double>& times) {
+  double total = 0;
+  for (double time : times) total += time;
+  std::cout << "  " << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(10) << total / std::max<size_t>(1, times.size())
+            << std::setw(10) << getPercentile(times, 50)
+            << std::setw(10) << getPercentile(times, 90)
+            << std::setw(10) << getPercentile(times, 99)
+            << std::setw(10) << getPercentile(times, 100) << std::endl;
+}
+
+// fnv-1a over every cell
+static unsigned long long hashScreen(const Screen& screen, unsigned long long hash) {
+  for (const Cell& cell : screen.buffer) {
+    hash = (hash ^ (unsigned char)cell.letter) * 1099511628211ULL;
+    hash = (hash ^ cell.colour) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// light every vertex and blend across faces, for --smooth
+static bool smoothShading = false;
+// only fill tiles that changed since the last frame, for --incremental
+static bool incrementalRendering = false;
+// draw every mesh in full however small it is, for --no-lod
+static bool fullDetail = false;
+// let a quality governor hold frames to this many milliseconds, for --budget ( 0 leaves quality alone )
+static double frameBudget = 0;
+// cull models with a bvh over the scene before they are submitted, and time picking and frustum queries, for --bvh
+static bool bvhCulling = false;
+
+static void runScene(std::string name, Scene scene, int frames, int warmupFrames, int width, int height, Renderer& renderer) {
+  if (smoothShading) {
+    for (Model& model : scene.models) model.mesh.setSmooth(true);
+    for (InstancedModel& instanced : scene.instancedModels) instanced.mesh.setSmooth(true);
+  }
+  if (fullDetail) {
+    for (Model& model : scene.models) model.mesh.lods.clear();
+    for (InstancedModel& instanced : scene.instancedModels) instanced.mesh.lods.clear();
+  }
+  Screen screen(width, height);
+  FrameEncoder encoder;
+  encoder.profiler = &renderer.profiler;
+  renderer.setIncremental(incrementalRendering);
+  renderer.resetArenaStats();
+  QualityGovernor governor(frameBudget);
+  SceneBvh bvh;
+  if (bvhCulling) bvh.build(scene);
+  double refitTime = 0;
+  long long refitObjects = 0;
+
+  std::vector<double> updateTimes, geometryTimes, rasterTimes, encodeTimes, frameTimes;
+  unsigned long long sequenceHash = 14695981039346656037ULL;
+  unsigned long long frameHash = 0;
+  long long bytes = 0;
+  CullStats cullStats = {};
+
+  for (int frame = -warmupFrames; frame < frames; ++frame) {
+    if (frame == 0) renderer.profiler.resetAverage();
+    Clock::time_point start = Clock::now();
+    scene.update();
+    Clock::time_point updated = Clock::now();
+
+    scene.drawModels(renderer, screen, bvhCulling ? &bvh : nullptr);
+    Clock::time_point transformed = Clock::now();
+
+    renderer.render(screen);
+    Clock::time_point rasterized = Clock::now();
+
+    const std::string& output = encoder.encode(screen);
+    Clock::time_point encoded = Clock::now();
+    renderer.profiler.endFrame();
+    if (frameBudget > 0 && governor.update(renderer.profiler.getLastFrame())) renderer.setQuality(governor.getSettings());
+
+    if (frame < 0) continue;
+    updateTimes.push_back(getMilliseconds(start, updated));
+    geometryTimes.push_back(getMilliseconds(updated, transformed));
+    rasterTimes.push_back(getMilliseconds(transformed, rasterized));
+    encodeTimes.push_back(getMilliseconds(rasterized, encoded));
+    frameTimes.push_back(getMilliseconds(start, encoded));
+
+    frameHash = hashScreen(screen, 14695981039346656037ULL);
+    sequenceHash = (sequenceHash ^ frameHash) * 1099511628211ULL;
+    bytes += output.size();
+    cullStats = renderer.getCullStats();
+    refitTime += bvh.getStats().refitMilliseconds;
+    refitObjects += bvh.getStats().refitObjects;
+  }
+
+  std::cout << "scene " << name << ": " << frames << " frames, " << width << "x" << height << ", "
+            << renderer.getThreadCount() << " threads, " << getVertexKernelName() << " kernel"
+            << (smoothShading ? ", smooth" : "") << (incrementalRendering ? ", incremental" : "") << (fullDetail ? ", no lod" : "");
+  if (frameBudget > 0) std::cout << ", budget " << frameBudget << " ms";
+  if (bvhCulling) std::cout << ", bvh";
+  std::cout << std::endl;
+  std::cout << "  stage           mean       p50       p90       p99       max  (ms)" << std::endl;
+  printStage("update", updateTimes);
+  printStage("geometry", geometryTimes);
+  printStage("raster", rasterTimes);
+  printStage("encode", encodeTimes);
+  printStage("frame", frameTimes);
+
+  double totalTime = 0;
+  for (double time : frameTimes) totalTime += time;
+  std::cout << "  frames/sec " << std::setprecision(1) << (totalTime > 0 ? frames * 1000 / totalTime : 0)
+            << ", output bytes/frame " << bytes / std::max(1, frames) << std::endl;
+  std::cout << "  faces " << cullStats.faces << ", culled: model " << cullStats.culledByModel << ", clipping " << cullStats.culledByClipping
+            << ", back " << cullStats.culledBackFacing << ", off screen " << cullStats.culledOffScreen << ", drawn " << cullStats.drawn << std::endl;
+#ifndef RENDERER_NO_PROFILE
+  FrameProfile profile = renderer.profiler.getAverage();
+  std::cout << "  profile (mean ms):";
+  for (int i = 0; i < STAGE_COUNT; ++i) std::cout << " " << Profiler::getStageName(i) << " " << std::setprecision(3) << profile.milliseconds[i];
+  std::cout << std::endl << "  counters (mean per frame):";
+  for (int i = 0; i < COUNTER_COUNT; ++i) {
+    if (i != COUNTER_BYTES_WRITTEN) std::cout << " " << Profiler::getCounterName(i) << " " << profile.counts[i];
+  }
+  std::cout << std::endl;
+#endif
+  ArenaStats arenaStats = renderer.getArenaStats();
+  std::cout << "  arena high water " << std::setprecision(1) << arenaStats.frameBytes / 1024.0 << " KB, per worker "
+            << arenaStats.workerBytes / 1024.0 << " KB, reserved " << arenaStats.capacityBytes / 1024.0 << " KB" << std::endl;
+  if (frameBudget > 0) {
+    std::string summary;
+    QualityGovernor::appendSummary(summary, governor);
+    std::cout << "  " << summary << ", " << governor.getDecisions().size() << " changes" << std::endl;
+    renderer.setQuality(QualitySettings{});
+  }
+  if (bvhCulling) {
+    // a ray through every cell of the last frame, then the frustum it was drawn with
+    int hits = 0;
+    RayHit hit;
+    Clock::time_point start = Clock::now();
+    for (int row = 0; row < height; ++row) {
+      for (int column = 0; column < width; ++column) hits += bvh.pick(scene, screen, column, row, hit);
+    }
+    double pickTime = getMilliseconds(start, Clock::now()) * 1000 / (width * height);
+    std::array<std::array<float, 4>, 5> planes = renderer.getWorldFrustum();
+    int queries = 1000;
+    start = Clock::now();
+    for (int i = 0; i < queries; ++i) bvh.queryFrustum(scene, planes);
+    double queryTime = getMilliseconds(start, Clock::now()) * 1000 / queries;
+    const BvhStats& stats = bvh.getStats();
+    std::cout << "  bvh " << stats.objects << " objects, " << stats.triangles << " triangles, build " << std::setprecision(3) << stats.buildMilliseconds
+              << " ms, refit " << refitTime / frames << " ms ( " << refitObjects / frames << " objects moved ), pick " << pickTime
+              << " us ( " << hits << " of " << width * height << " cells hit ), frustum query " << queryTime << " us" << std::endl;
+  }
+  std::cout << "  last frame hash " << std::hex << std::setw(16) << std::setfill('0') << frameHash
+            << ", all frames hash " << std::setw(16) << sequenceHash << std::dec << std::setfill(' ') << std::endl;
+}
+
+// once a scene has been drawn for a while ( and every buffer has grown to fit ) drawing a frame
+// should not allocate at all
+static bool checkAllocations(int width, int height, Renderer& renderer) {
+  bool passed = true;
+  for (const BenchScene& benchScene : benchScenes) {
+    Scene scene = benchScene.make();
+    Screen screen(width, height);
+    FrameEncoder encoder;
+    encoder.profiler = &renderer.profiler;
+    long long allocations = 0;
+    for (int frame = -100; frame < 200; ++frame) {
+      if (frame == 0) allocations = allocationCount;
+      scene.update();
+      scene.draw(renderer, screen);
+      encoder.encode(screen);
+      renderer.profiler.endFrame();
+    }
+    allocations = allocationCount - allocations;
+    std::cout << "allocations " << benchScene.name << ": " << allocations << " in 200 frames" << std::endl;
+    if (allocations != 0) passed = false;
+  }
+  return passed;
+}
+
+static bool sameCells(const Screen& a, const Screen& b) {
+  if (a.buffer.size() != b.buffer.size()) return false;
+  for (int cell = 0; cell < a.buffer.size(); ++cell) {
+    if (a.buffer[cell].letter != b.buffer[cell].letter || a.buffer[cell].colour != b.buffer[cell].colour) return false;
+  }
+  return true;
+}
+
+// draws two copies of a scene side by side, the first with renderers[0] and the second with
+// renderers[1] ( culling with bvh, if given ), and counts the frames whose cells differ. change( frame,
+// scene, renderer ) is called on each copy before it is updated, and the allocations made in frames
+// isCounted( frame ) picks are added to allocations
+template <typename Change, typename IsCounted>
+static int countDifferentFrames(Scene (&scenes)[2], Screen (&screens)[2], Renderer* (&renderers)[2], SceneBvh* bvh, int frames,
+                                Change change, IsCounted isCounted, long long& allocations) {
+  int differentFrames = 0;
+  for (int frame = 0; frame < frames; ++frame) {
+    long long before = allocationCount;
+    for (int i = 0; i < 2; ++i) {
+      change(frame, scenes[i], *renderers[i]);
+      scenes[i].update();
+      scenes[i].draw(*renderers[i], screens[i], i ? bvh : nullptr);
+      renderers[i]->profiler.endFrame();
+    }
+    if (isCounted(frame)) allocations += allocationCount - before;
+    if (!sameCells(screens[0], screens[1])) differentFrames++;
+  }
+  return differentFrames;
+}
+
+// incremental rendering has to give the same cells as filling every tile, while models spin, the
+// camera and lights move and nodes are moved by hand
+static bool checkIncremental(int width, int height, int threadCount) {
+  bool passed = true;
+  for (const BenchScene& benchScene : benchScenes) {
+    Scene scenes[2] = { benchScene.make(), benchScene.make() };
+    Screen screens[2] = { Screen(width, height), Screen(width, height) };
+    Renderer full(threadCount), incremental(threadCount);
+    incremental.setIncremental(true);
+    Renderer* renderers[2] = { &full, &incremental };
+    long long allocations = 0;
+    int differentFrames = countDifferentFrames(scenes, screens, renderers, nullptr, 200, [](int frame, Scene& scene, Renderer&) {
+      if (frame == 50) scene.camera.position[0] += 3;
+      if (frame == 80) scene.lightSources[0][3] /= 2;
+      if (frame >= 120 && frame < 130) scene.translateNode(scene.nodes.size() - 1, 1, 0, 0.5f);
+      if (frame == 160) scene.nodes[0].spin = { 0, 0, 0 };
+    }, [](int) { return false; }, allocations);
+    std::cout << "incremental " << benchScene.name << ": " << (differentFrames ? "FAILED" : "ok") << ", " << differentFrames << " frames differ" << std::endl;
+    if (differentFrames) passed = false;
+  }
+  return passed;
+}
+
+// a small cube under a node that scales it up 40 times, partly off the right of the screen, has to be
+// culled and sized by its scaled bounds, both as a model and as an instance
+static bool checkScaledNodes(int width, int height, Renderer& renderer) {
+  std::vector<std::string> colours(12, "\033[32m");
+  Matrix scaled = { { { 40, 0, 0, 230 }, { 0, 40, 0, 0 }, { 0, 0, 40, 0 } } };
+  bool passed = true;
+  for (bool instanced : { false, true }) {
+    Scene scene;
+    scene.camera = { { 0, -200, 0 }, { 0, 0, 0 }, 100 };
+    scene.lightSources = { { 0, -400, 0, 10 } };
+    int node = scene.addNode(-1, scaled);
+    Model cube = makeCube({ 0, 0, 0 }, 1, defaultLetters, colours);
+    if (instanced) {
+      int holder = scene.addInstancedModel(cube.mesh, node);
+      scene.instancedModels[scene.nodes[holder].instanced].instances.push_back(Instance{ getIdentityMatrix(), -1 });
+    } else {
+      scene.addModel(cube, node);
+    }
+    Screen screen(width, height);
+    scene.draw(renderer, screen);
+    renderer.profiler.endFrame();
+    int filled = 0;
+    for (const Cell& cell : screen.buffer) filled += cell.letter != ' ';
+    bool ok = filled > 0 && renderer.getCullStats().culledByModel == 0;
+    std::cout << "scaled " << (instanced ? "instance" : "model") << ": " << (ok ? "ok" : "FAILED") << ", " << filled << " cells filled, "
+              << renderer.getCullStats().culledByModel << " faces culled whole" << std::endl;
+    if (!ok) passed = false;
+  }
+  return passed;
+}
+
+// the sum of the stages a quality governor watches
+static double getGovernedMilliseconds(const FrameProfile& profile) {
+  return profile.milliseconds[STAGE_TRANSFORM] + profile.milliseconds[STAGE_SHADE] + profile.milliseconds[STAGE_BIN] + profile.milliseconds[STAGE_RASTER];
+}
+
+// a quality governor fed made up frames, whose times depend on its settings, has to settle under its
+// budget, come back up once frames get cheaper and not keep swinging between two settings. then every
+// setting it can pick is drawn for real, switching between them, checking that incremental rendering
+// still matches full frames and that a frame at a steady setting doesn't allocate
+static bool checkGovernor(int width, int height, int threadCount) {
+  double load = 1.5;
+  auto getProfile = [&](const QualitySettings& settings) {
+    FrameProfile profile = {};
+    double shade = settings.lighting == LIGHTING_SMOOTH ? 12 : settings.lighting == LIGHTING_FLAT ? 6 : 2;
+    profile.milliseconds[STAGE_RASTER] = load * 30 / (settings.resolutionScale * settings.resolutionScale);
+    profile.milliseconds[STAGE_SHADE] = load * shade * (settings.maxLights < 0 ? 1 : 0.8);
+    profile.milliseconds[STAGE_TRANSFORM] = load * 8 * settings.lodBias;
+    return profile;
+  };
+  QualityGovernor governor(33);
+  for (int frame = 0; frame < 600; ++frame) governor.update(getProfile(governor.getSettings()));
+  int loweredLevel = governor.getLevel();
+  bool settled = loweredLevel > 0 && getGovernedMilliseconds(getProfile(governor.getSettings())) <= 33 &&
+                 governor.getDecisions().back().frame < 300;
+  load = 0.3;
+  for (int frame = 0; frame < 2000; ++frame) governor.update(getProfile(governor.getSettings()));
+  bool recovered = governor.getLevel() == 0;
+
+  // just over budget in full and well under one step down, so every raise gets taken back
+  QualityGovernor swinging(33);
+  int swings = 0;
+  for (int frame = 0; frame < 4000; ++frame) {
+    FrameProfile profile = {};
+    profile.milliseconds[STAGE_RASTER] = swinging.getSettings().resolutionScale == 1 ? 34 : 10;
+    if (swinging.update(profile) && frame >= 2000) swings++;
+  }
+  bool steady = swings < 20;
+  std::cout << "governor: " << (settled && recovered && steady ? "ok" : "FAILED") << ", " << loweredLevel << " steps down under load, "
+            << (recovered ? "back up" : "not back up") << " after, " << swings << " changes in 2000 frames at the edge" << std::endl;
+  bool passed = settled && recovered && steady;
+
+  QualitySettings cheapest = { 3, 0.125f, LIGHTING_NONE, 1 };
+  QualitySettings flat = { 1, 0.5f, LIGHTING_FLAT, -1 };
+  QualitySettings scaled = { 2, 1, LIGHTING_SMOOTH, 2 };
+  std::vector<QualitySettings> settingsList = { QualitySettings{}, scaled, flat, cheapest, scaled, QualitySettings{} };
+  for (const char* name : { "demo", "lod" }) {
+    const BenchScene& benchScene = *std::find_if(std::begin(benchScenes), std::end(benchScenes), [&](const BenchScene& scene) { return scene.name == name; });
+    Scene scenes[2] = { benchScene.make(), benchScene.make() };
+    Screen screens[2] = { Screen(width, height), Screen(width, height) };
+    Renderer full(threadCount), incremental(threadCount);
+    incremental.setIncremental(true);
+    Renderer* renderers[2] = { &full, &incremental };
+    long long allocations = 0;
+    int differentFrames = countDifferentFrames(scenes, screens, renderers, nullptr, settingsList.size() * 30, [&](int frame, Scene&, Renderer& renderer) {
+      if (frame % 30 == 0) renderer.setQuality(settingsList[frame / 30]);
+    }, [](int frame) { return frame % 30 >= 20; }, allocations);
+    bool ok = differentFrames == 0 && allocations == 0;
+    std::cout << "quality " << benchScene.name << ": " << (ok ? "ok" : "FAILED") << ", " << differentFrames << " frames differ, "
+              << allocations << " allocations at steady settings" << std::endl;
+    if (!ok) passed = false;
+  }
+  return passed;
+}
+
+static unsigned long long hashBytes(const std::string& bytes) {
+  unsigned long long hash = 14695981039346656037ULL;
+  for (char c : bytes) hash = (hash ^ (unsigned char)c) * 1099511628211ULL;
+  return hash;
+}
+
+// draws a scene's spin animation as a batch on 1, 2, 4 .. threads, for how throughput grows with them
+static void runBatch(std::string name, const Scene& scene, int frames, int width, int height, int threadCount) {
+  std::cout << "batch " << name << ": " << frames << " frames, " << width << "x" << height << std::endl;
+  Timeline timeline = makeSpinTimeline(scene, frames);
+  for (int threads = 1; ; threads = std::min(threads * 2, threadCount)) {
+    std::ostringstream output;
+    BatchStats stats = renderBatch(scene, timeline, width, height, threads, BATCH_CELLS, output);
+    std::cout << "  " << std::setw(3) << threads << " threads: " << std::fixed << std::setprecision(1) << stats.frames * 1000 / std::max(0.001, stats.milliseconds)
+              << " frames/sec, hash " << std::hex << std::setw(16) << std::setfill('0') << hashBytes(output.str()) << std::dec << std::setfill(' ') << std::endl;
+    if (threads == threadCount) break;
+  }
+}
+
+// a batch has to come out byte for byte the same on any number of threads, in every format. posing a
+// frame of a scene's spins has to put every node where updating it that many times does, on the
+// closeup scene's cube that turns about all three axes at once
+static bool checkBatch(int width, int height) {
+  Scene start = makeCloseUpScene(), updated = start, posed = start;
+  Timeline spins = makeSpinTimeline(start, 600);
+  float largestError = 0;
+  for (int frame = 1; frame < spins.frameCount; ++frame) {
+    updated.update();
+    if (frame % 37 != 0 && frame != spins.frameCount - 1) continue;
+    posed.pose(start, spins, frame);
+    for (int i = 0; i < posed.nodes.size(); ++i) {
+      for (int row = 0; row < 3; ++row) {
+        for (int column = 0; column < 4; ++column) largestError = std::max(largestError, std::fabs(posed.nodes[i].local[row][column] - updated.nodes[i].local[row][column]));
+      }
+    }
+  }
+  bool passed = largestError < 1e-3f;
+  std::cout << "pose closeup: " << (passed ? "ok" : "FAILED") << ", largest difference from updating " << std::scientific << std::setprecision(1)
+            << largestError << std::defaultfloat << " in " << spins.frameCount << " frames" << std::endl;
+  for (const char* name : { "demo", "lod" }) {
+    const BenchScene& benchScene = *std::find_if(std::begin(benchScenes), std::end(benchScenes), [&](const BenchScene& scene) { return scene.name == name; });
+    Scene scene = benchScene.make();
+    Timeline timeline = makeSpinTimeline(scene, 60);
+    int differentFormats = 0;
+    for (BatchFormat format : { BATCH_CELLS, BATCH_ANSI, BATCH_PPM }) {
+      std::ostringstream outputs[2];
+      renderBatch(scene, timeline, width, height, 1, format, outputs[0]);
+      renderBatch(scene, timeline, width, height, 3, format, outputs[1]);
+      if (outputs[0].str() != outputs[1].str() || outputs[0].str().empty()) differentFormats++;
+    }
+    std::cout << "batch " << name << ": " << (differentFormats ? "FAILED" : "ok") << ", " << differentFormats << " formats differ between 1 and 3 threads" << std::endl;
+    if (differentFormats) passed = false;
+  }
+  return passed;
+}
+
+// the number in a colour's escape code ( "\033[36m" is 36 ), 0 for the default colour
+static int getSgrNumber(const std::string& code) {
+  int number = 0;
+  for (char c : code) {
+    if (c >= '0' && c <= '9') number = number * 10 + c - '0';
+  }
+  return number;
+}
+
+// the letters a terminal shows after being sent what FrameEncoder writes, starting out blank, and the
+// sgr colour number each was written in
+class TerminalModel {
+public:
+  std::vector<char> letters;
+  std::vector<int> colours;
+
+  TerminalModel(int terminalWidth, int terminalHeight) : letters(terminalWidth * terminalHeight, ' '), colours(terminalWidth * terminalHeight, 0) {
+    width = terminalWidth;
+    height = terminalHeight;
+  }
+
+  void feed(const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      char c = data[i];
+      if (inEscape) {
+        if (c == '[' || (c >= '0' && c <= '9') || c == ';') {
+          escape += c;
+          continue;
+        }
+        inEscape = false;
+        runEscape(c);
+      } else if (c == '\033') {
+        inEscape = true;
+        escape.clear();
+      } else if (c == '\r') {
+        column = 0;
+      } else if (c == '\n') {
+        row++;
+      } else {
+        if (row < height && column < width) {
+          letters[row * width + column] = c;
+          colours[row * width + column] = colour;
+        }
+        column++;
+      }
+    }
+  }
+
+private:
+  int width;
+  int height;
+  int row = 0;
+  int column = 0;
+  int colour = 0;
+  bool inEscape = false;
+  std::string escape;
+
+  // the numbers after the [ of the escape, defaulting to 1
+  int getNumber(int index) {
+    int number = 0, found = 0;
+    for (size_t i = 1; i <= escape.size(); ++i) {
+      if (i < escape.size() && escape[i] != ';') {
+        number = number * 10 + escape[i] - '0';
+        continue;
+      }
+      if (found++ == index) return number ? number : 1;
+      number = 0;
+    }
+    return 1;
+  }
+
+  void runEscape(char command) {
+    if (command == 'H') {
+      row = getNumber(0) - 1;
+      column = getNumber(1) - 1;
+    } else if (command == 'C') {
+      column += getNumber(0);
+    } else if (command == 'J') {
+      std::fill(letters.begin(), letters.end(), ' ');
+      std::fill(colours.begin(), colours.end(), 0);
+    } else if (command == 'm') {
+      colour = getSgrNumber(escape);
+    }
+  }
+};
+
+// serves frames to two local clients, one reading as they come and one that only starts reading
+// near the end, and checks both end up showing the last frame. the slow client has to skip frames to
+// get there, without holding up broadcast
+static bool checkServer(int width, int height, Renderer& renderer) {
+  std::string path = "/tmp/renderer_bench_" + std::to_string(getpid()) + ".sock";
+  std::unique_ptr<FrameServer> server(new FrameServer());
+  server->maxQueuedFrames = 4;
+  int fast = -1, slow = -1;
+  if (server->listen(path)) {
+    fast = connectToFrameServer(path);
+    slow = connectToFrameServer(path);
+  }
+  if (fast < 0 || slow < 0) {
+    std::cout << "server: FAILED, could not connect to " << path << std::endl;
+    return false;
+  }
+  for (int tries = 0; tries < 1000 && server->getStats().clients < 2; ++tries) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  TerminalModel fastView(width, height), slowView(width, height);
+  auto readAll = [](int connection, TerminalModel* view) {
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(connection, buffer, sizeof(buffer))) > 0) view->feed(buffer, count);
+    close(connection);
+  };
+  std::thread fastReader(readAll, fast, &fastView);
+  std::thread slowReader;
+
+  // the lod scene changes a lot of cells every frame, soon filling the slow client's socket
+  Scene scene = makeLodScene();
+  Screen screen(width, height);
+  renderer.setIncremental(false);
+  double slowest = 0;
+  int frames = 150;
+  for (int frame = 0; frame < frames; ++frame) {
+    if (frame == frames - 30) slowReader = std::thread(readAll, slow, &slowView);
+    scene.update();
+    scene.draw(renderer, screen);
+    renderer.profiler.endFrame();
+    Clock::time_point start = Clock::now();
+    server->broadcast(screen);
+    slowest = std::max(slowest, getMilliseconds(start, Clock::now()));
+  }
+  bool sent = server->waitUntilSent(5000);
+  ServerStats stats = server->getStats();
+  server.reset();
+  fastReader.join();
+  slowReader.join();
+
+  bool fastSame = true, slowSame = true;
+  for (int cell = 0; cell < screen.buffer.size(); ++cell) {
+    int colour = getSgrNumber(getColourCode(screen.buffer[cell].colour));
+    fastSame = fastSame && fastView.letters[cell] == screen.buffer[cell].letter && fastView.colours[cell] == colour;
+    slowSame = slowSame && slowView.letters[cell] == screen.buffer[cell].letter && slowView.colours[cell] == colour;
+  }
+  bool passed = sent && fastSame && slowSame && stats.framesDropped > 0;
+  std::cout << "server: " << (passed ? "ok" : "FAILED") << ", " << frames << " frames, " << stats.keyframes << " keyframes, "
+            << stats.framesDropped << " dropped, slowest broadcast " << std::fixed << std::setprecision(3) << slowest << " ms"
+            << (fastSame ? "" : ", fast client differs") << (slowSame ? "" : ", slow client differs") << (sent ? "" : ", not all sent") << std::endl;
+  return passed;
+}
+
+// the nearest hit of a ray through every face of every object, without any bvh
+static bool raycastEveryFace(const Scene& scene, const SceneBvh& bvh, std::array<float, 3> origin, std::array<float, 3> direction, RayHit& hit) {
+  float distance = std::numeric_limits<float>::infinity();
+  bool found = false;
+  for (const BvhObject& object : bvh.getObjects()) {
+    const SceneNode& node = scene.nodes[object.node];
+    const Mesh& mesh = object.instance < 0 ? scene.models[node.model].mesh : scene.instancedModels[node.instanced].mesh;
+    int face;
+    if (raycastMesh(mesh, transformVertex(object.inverse, origin), rotateDirection(object.inverse, direction), distance, face, false)) {
+      hit = RayHit{ object.node, object.instance, face, distance, {} };
+      found = true;
+    }
+  }
+  return found;
+}
+
+// culling with a bvh has to give the same cells as leaving it to the renderer, while models spin and
+// the camera and nodes move, without allocating once it has been built. picking a cell has to find
+// the same face as trying every face of every object
+static bool checkBvh(int width, int height, int threadCount) {
+  bool passed = true;
+  for (const BenchScene& benchScene : benchScenes) {
+    Scene scenes[2] = { benchScene.make(), benchScene.make() };
+    Screen screens[2] = { Screen(width, height), Screen(width, height) };
+    Renderer plain(threadCount), culled(threadCount);
+    Renderer* renderers[2] = { &plain, &culled };
+    SceneBvh bvh;
+    bvh.build(scenes[1]);
+    long long allocations = 0;
+    int differentFrames = countDifferentFrames(scenes, screens, renderers, &bvh, 150, [](int frame, Scene& scene, Renderer&) {
+      if (frame == 40) scene.camera.position[0] += 60;
+      if (frame == 60) scene.camera.rotation[2] += 0.4f;
+      if (frame >= 70 && frame < 80) scene.translateNode(scene.nodes.size() - 1, 8, 0, 4);
+    }, [](int frame) { return frame >= 100; }, allocations);
+
+    // every face is tried for each ray, so only some cells
+    int rays = 0, wrongPicks = 0;
+    const Scene& scene = scenes[1];
+    Matrix view = scene.camera.getViewMatrix();
+    for (int row = 0; row < height; row += std::max(1, height / 10)) {
+      for (int column = 0; column < width; column += std::max(1, width / 20)) {
+        RayHit picked, expected;
+        bool found = bvh.pick(scene, screens[1], column, row, picked);
+        std::array<float, 3> cameraDirection = { (float)(column - width / 2) / scene.camera.focalLength, 1, (float)(height / 2 - row) / scene.camera.focalLength };
+        std::array<float, 3> direction;
+        for (int i = 0; i < 3; ++i) direction[i] = view[0][i] * cameraDirection[0] + view[1][i] * cameraDirection[1] + view[2][i] * cameraDirection[2];
+        bool expectedFound = raycastEveryFace(scene, bvh, scene.camera.position, direction, expected);
+        // faces meeting at an edge can both be hit at the same distance
+        bool same = found == expectedFound && (!found || std::fabs(picked.distance - expected.distance) <= 1e-4f * expected.distance);
+        rays++;
+        if (!same) wrongPicks++;
+      }
+    }
+    bool ok = differentFrames == 0 && allocations == 0 && wrongPicks == 0;
+    std::cout << "bvh " << benchScene.name << ": " << (ok ? "ok" : "FAILED") << ", " << differentFrames << " frames differ, " << allocations
+              << " allocations in 50 frames, " << wrongPicks << " of " << rays << " picks wrong" << std::endl;
+    if (!ok) passed = false;
+  }
+  return passed;
+}
+
+// times loading a mesh file and getting its first frame on screen, then does the same from the native
+// cache written next to it
+static bool runLoad(std::string path, int frames, int warmupFrames, int width, int height, Renderer& renderer) {
+  std::vector<std::string> paths = { path };
+  if (path.size() < 5 || path.compare(path.size() - 5, 5, ".mesh") != 0) paths.push_back(path + ".mesh");
+
+  Scene scene;
+  for (int i = 0; i < paths.size(); ++i) {
+    std::ifstream file(paths[i], std::ios::binary | std::ios::ate);
+    double megabytes = file ? file.tellg() / 1e6 : 0;
+
+    Clock::time_point start = Clock::now();
+    Mesh mesh;
+    if (!loadMesh(paths[i], mesh, defaultLetters, "\033[36m")) {
+      std::cerr << "could not load " << paths[i] << std::endl;
+      return false;
+    }
+    Clock::time_point loaded = Clock::now();
+    double loadTime = getMilliseconds(start, loaded);
+    std::cout << "load " << paths[i] << ": " << std::fixed << std::setprecision(1) << megabytes << " MB, "
+              << mesh.getVertexCount() << " vertices, " << mesh.getFaceCount() << " faces" << std::endl;
+
+    // simplifying and writing the cache are left out of the timings, the cache keeps the simpler versions
+    if (mesh.lods.empty() && !fullDetail) {
+      Clock::time_point simplifyStart = Clock::now();
+      mesh.buildLods();
+      std::cout << "  " << mesh.lods.size() << " levels of detail down to " << (mesh.lods.empty() ? mesh.getFaceCount() : mesh.lods.back().getFaceCount())
+                << " faces in " << std::fixed << std::setprecision(1) << getMilliseconds(simplifyStart, Clock::now()) << " ms" << std::endl;
+    }
+    if (i == 0 && paths.size() > 1 && !saveMeshCache(paths[1], mesh)) {
+      std::cerr << "could not write " << paths[1] << std::endl;
+      return false;
+    }
+
+    Clock::time_point sceneStart = Clock::now();
+    scene = makeMeshScene(std::move(mesh));
+    Screen screen(width, height);
+    FrameEncoder encoder;
+    scene.draw(renderer, screen);
+    encoder.encode(screen);
+    double firstFrameTime = loadTime + getMilliseconds(sceneStart, Clock::now());
+
+    std::cout << "  parse " << std::setprecision(3) << loadTime << " ms (" << std::setprecision(1) << (loadTime > 0 ? megabytes * 1000 / loadTime : 0)
+              << " MB/s), time to first frame " << std::setprecision(3) << firstFrameTime << " ms" << std::endl;
+  }
+
+  runScene(path, scene, frames, warmupFrames, width, height, renderer);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  // --frames n, --warmup n, --threads n, --size wxh, --kernel name, --scene name ( repeatable, defaults to all )
+  // --load path times loading an .obj, .stl or .mesh file ( writing path.mesh for the next run ) and renders it
+  // --smooth shades every mesh smoothly
+  // --no-lod draws every mesh in full, to compare against the simpler versions picked by size
+  // --batch draws each scene's animation with renderBatch on 1, 2, 4 .. threads instead of timing its stages
+  // --budget ms lets a quality governor lower quality to keep frames under ms ( the hashes then depend on timing )
+  // --bvh culls models with a bvh before submitting them, and reports its build, refit, pick and frustum query times
+  // --check runs the self checks ( kernels, no allocations while drawing frames, incremental
+  // rendering matching full frames, models under scaled nodes being drawn, the quality governor, posed frames matching updated ones, batches matching on any thread count, serving frames to a fast and a slow client, and bvh culling and picking ) and exits
+  int frames = 300;
+  int warmupFrames = 10;
+  int threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+  int width = 200;
+  int height = 80;
+  std::vector<std::string> sceneNames;
+  std::vector<std::string> loadPaths;
+  bool batch = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string argument = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (argument == "--frames" && hasValue) frames = std::max(1, std::atoi(argv[++i]));
+    else if (argument == "--warmup" && hasValue) warmupFrames = std::max(0, std::atoi(argv[++i]));
+    else if (argument == "--threads" && hasValue) threadCount = std::max(1, std::atoi(argv[++i]));
+    else if (argument == "--size" && hasValue && std::sscanf(argv[i + 1], "%dx%d", &width, &height) == 2) i++;
+    else if (argument == "--scene" && hasValue) sceneNames.push_back(argv[++i]);
+    else if (argument == "--load" && hasValue) loadPaths.push_back(argv[++i]);
+    else if (argument == "--smooth") smoothShading = true;
+    else if (argument == "--incremental") incrementalRendering = true;
+    else if (argument == "--no-lod") fullDetail = true;
+    else if (argument == "--batch") batch = true;
+    else if (argument == "--bvh") bvhCulling = true;
+    else if (argument == "--budget" && hasValue) frameBudget = std::max(0.0, std::atof(argv[++i]));
+    else if (argument == "--kernel" && hasValue) {
+      if (!setVertexKernel(argv[++i])) {
+        std::cerr << "unsupported kernel " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (argument == "--check") {
+      bool passed = checkVertexKernels();
+      Renderer renderer(threadCount);
+      if (!checkAllocations(width, height, renderer)) passed = false;
+      if (!checkIncremental(width, height, threadCount)) passed = false;
+      if (!checkScaledNodes(width, height, renderer)) passed = false;
+      if (!checkGovernor(width, height, threadCount)) passed = false;
+      if (!checkBatch(width, height)) passed = false;
+      if (!checkServer(width, height, renderer)) passed = false;
+      if (!checkBvh(width, height, threadCount)) passed = false;
+      return passed ? 0 : 1;
+    } else {
+      std::cerr << "unknown argument " << argument << std::endl;
+      return 1;
+    }
+  }
+
+  Renderer renderer(threadCount);
+  for (const std::string& path : loadPaths) {
+    if (!runLoad(path, frames, warmupFrames, width, height, renderer)) return 1;
+  }
+  if (!loadPaths.empty() && sceneNames.empty()) return 0;
+
+  for (const BenchScene& benchScene : benchScenes) {
+    if (!sceneNames.empty() && std::find(sceneNames.begin(), sceneNames.end(), benchScene.name) == sceneNames.end()) continue;
+    if (batch) runBatch(benchScene.name, benchScene.make(), frames, width, height, threadCount);
+    else runScene(benchScene.name, benchScene.make(), frames, warmupFrames, width, height, renderer);
+  }
+  return 0;
+}
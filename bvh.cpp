@@ -0,0 +1,462 @@
+#include "renderer.hpp"
+
+static BoundingBox getEmptyBox() {
+  float inf = std::numeric_limits<float>::infinity();
+  return BoundingBox{ { inf, inf, inf }, { -inf, -inf, -inf } };
+}
+
+static void growBox(BoundingBox& box, const BoundingBox& other) {
+  for (int i = 0; i < 3; ++i) {
+    box.min[i] = std::min(box.min[i], other.min[i]);
+    box.max[i] = std::max(box.max[i], other.max[i]);
+  }
+}
+
+static void growBox(BoundingBox& box, const std::array<float, 3>& point) {
+  for (int i = 0; i < 3; ++i) {
+    box.min[i] = std::min(box.min[i], point[i]);
+    box.max[i] = std::max(box.max[i], point[i]);
+  }
+}
+
+// half the surface area, all the heuristic needs to compare splits
+static float getHalfArea(const BoundingBox& box) {
+  float x = box.max[0] - box.min[0], y = box.max[1] - box.min[1], z = box.max[2] - box.min[2];
+  if (x < 0 || y < 0 || z < 0) return 0;
+  return x * y + y * z + z * x;
+}
+
+// a part of the items still to be split, below nodes[node]
+struct BuildTask {
+  int node;
+  int first;
+  int count;
+  int depth;
+};
+
+void Bvh::build(const std::vector<BoundingBox>& boxes) {
+  nodes.clear();
+  items.resize(boxes.size());
+  for (int i = 0; i < boxes.size(); ++i) items[i] = i;
+  if (boxes.empty()) return;
+  nodes.reserve(boxes.size()); // leaves hold about two items, so about as many nodes as items
+
+  std::vector<std::array<float, 3>> centres(boxes.size());
+  for (int i = 0; i < boxes.size(); ++i) {
+    for (int j = 0; j < 3; ++j) centres[i][j] = (boxes[i].min[j] + boxes[i].max[j]) / 2;
+  }
+
+  std::vector<BuildTask> tasks = { BuildTask{ 0, 0, (int)boxes.size(), 0 } };
+  nodes.push_back(BvhNode{ getEmptyBox(), 0, (int)boxes.size() });
+  while (!tasks.empty()) {
+    BuildTask task = tasks.back();
+    tasks.pop_back();
+    BoundingBox bounds = getEmptyBox(), centreBounds = getEmptyBox();
+    for (int i = task.first; i < task.first + task.count; ++i) {
+      growBox(bounds, boxes[items[i]]);
+      growBox(centreBounds, centres[items[i]]);
+    }
+    nodes[task.node] = BvhNode{ bounds, task.first, task.count };
+    if (task.count <= 2) continue;
+
+    int largestAxis = 0;
+    for (int axis = 1; axis < 3; ++axis) {
+      if (centreBounds.max[axis] - centreBounds.min[axis] > centreBounds.max[largestAxis] - centreBounds.min[largestAxis]) largestAxis = axis;
+    }
+    int* first = items.data() + task.first;
+    int* end = first + task.count;
+    int* middle = nullptr;
+
+    if (task.depth < SAH_DEPTH) {
+      // the cost of a split is the area of each side times the items in it, made relative to the parent
+      float bestCost = std::numeric_limits<float>::infinity();
+      int bestAxis = -1, bestBin = 0;
+      for (int axis = 0; axis < 3; ++axis) {
+        float low = centreBounds.min[axis], extent = centreBounds.max[axis] - low;
+        if (extent <= 0) continue;
+        std::array<BoundingBox, BINS> binBounds;
+        std::array<int, BINS> binCounts = {};
+        binBounds.fill(getEmptyBox());
+        for (int* item = first; item < end; ++item) {
+          int bin = std::min(BINS - 1, (int)((centres[*item][axis] - low) * BINS / extent));
+          binCounts[bin]++;
+          growBox(binBounds[bin], boxes[*item]);
+        }
+        // the area and count of every bin up to and including each one, then of those after it
+        std::array<float, BINS> leftAreas;
+        std::array<int, BINS> leftCounts;
+        BoundingBox side = getEmptyBox();
+        int count = 0;
+        for (int bin = 0; bin < BINS - 1; ++bin) {
+          growBox(side, binBounds[bin]);
+          count += binCounts[bin];
+          leftAreas[bin] = getHalfArea(side);
+          leftCounts[bin] = count;
+        }
+        side = getEmptyBox();
+        count = 0;
+        for (int bin = BINS - 1; bin > 0; --bin) {
+          growBox(side, binBounds[bin]);
+          count += binCounts[bin];
+          float cost = leftAreas[bin - 1] * leftCounts[bin - 1] + getHalfArea(side) * count;
+          if (leftCounts[bin - 1] > 0 && count > 0 && cost < bestCost) {
+            bestCost = cost;
+            bestAxis = axis;
+            bestBin = bin - 1;
+          }
+        }
+      }
+
+      // keep it as a leaf when splitting doesn't pay for the extra node
+      if (task.count <= MAX_LEAF_ITEMS && (bestAxis < 0 || bestCost >= getHalfArea(bounds) * task.count)) continue;
+      if (bestAxis >= 0) {
+        float low = centreBounds.min[bestAxis], extent = centreBounds.max[bestAxis] - low;
+        middle = std::partition(first, end, [&](int item) {
+          return std::min(BINS - 1, (int)((centres[item][bestAxis] - low) * BINS / extent)) <= bestBin;
+        });
+      }
+    }
+    if (!middle || middle == first || middle == end) {
+      middle = first + task.count / 2;
+      std::nth_element(first, middle, end, [&](int a, int b) { return centres[a][largestAxis] < centres[b][largestAxis]; });
+    }
+
+    int left = nodes.size();
+    nodes.push_back(BvhNode{});
+    nodes.push_back(BvhNode{});
+    nodes[task.node].first = left;
+    nodes[task.node].count = 0;
+    tasks.push_back(BuildTask{ left, task.first, (int)(middle - first), task.depth + 1 });
+    tasks.push_back(BuildTask{ left + 1, (int)(middle - items.data()), (int)(end - middle), task.depth + 1 });
+  }
+}
+
+// fits every node around the boxes again after they moved, keeping the same tree. it gets slower to
+// query the further the boxes have moved from where it was built
+void Bvh::refit(const std::vector<BoundingBox>& boxes) {
+  for (int i = nodes.size() - 1; i >= 0; --i) {
+    BvhNode& node = nodes[i];
+    node.bounds = getEmptyBox();
+    if (node.count > 0) {
+      for (int item = node.first; item < node.first + node.count; ++item) growBox(node.bounds, boxes[items[item]]);
+    } else {
+      growBox(node.bounds, nodes[node.first].bounds);
+      growBox(node.bounds, nodes[node.first + 1].bounds);
+    }
+  }
+}
+
+void Mesh::buildBvh() {
+  std::vector<BoundingBox> boxes(getFaceCount());
+  for (int face = 0; face < getFaceCount(); ++face) {
+    boxes[face] = getEmptyBox();
+    for (int j = 0; j < 3; ++j) {
+      int vertex = indices[face * 3 + j];
+      growBox(boxes[face], std::array<float, 3>{ xs[vertex], ys[vertex], zs[vertex] });
+    }
+  }
+  bvh.build(boxes);
+}
+
+// where a ray enters a box, if it does before limit ( inverse is one over each part of its direction )
+static float getBoxEntry(const BoundingBox& box, const std::array<float, 3>& origin, const std::array<float, 3>& inverse, float limit) {
+  float near = 0, far = limit;
+  for (int i = 0; i < 3; ++i) {
+    float a = (box.min[i] - origin[i]) * inverse[i];
+    float b = (box.max[i] - origin[i]) * inverse[i];
+    near = std::max(near, std::min(a, b));
+    far = std::min(far, std::max(a, b));
+  }
+  return near <= far ? near : std::numeric_limits<float>::infinity();
+}
+
+// how far along the ray it meets the triangle ( möller and trumbore ), from either side
+static bool intersectTriangle(const Mesh& mesh, int face, const std::array<float, 3>& origin, const std::array<float, 3>& direction, float& distance) {
+  int a = mesh.indices[face * 3], b = mesh.indices[face * 3 + 1], c = mesh.indices[face * 3 + 2];
+  std::array<float, 3> ab = { mesh.xs[b] - mesh.xs[a], mesh.ys[b] - mesh.ys[a], mesh.zs[b] - mesh.zs[a] };
+  std::array<float, 3> ac = { mesh.xs[c] - mesh.xs[a], mesh.ys[c] - mesh.ys[a], mesh.zs[c] - mesh.zs[a] };
+  std::array<float, 3> p = { direction[1] * ac[2] - direction[2] * ac[1], direction[2] * ac[0] - direction[0] * ac[2], direction[0] * ac[1] - direction[1] * ac[0] };
+  float determinant = ab[0] * p[0] + ab[1] * p[1] + ab[2] * p[2];
+  if (std::fabs(determinant) < 1e-12f) return false;
+  float inverse = 1 / determinant;
+  std::array<float, 3> ao = { origin[0] - mesh.xs[a], origin[1] - mesh.ys[a], origin[2] - mesh.zs[a] };
+  float u = (ao[0] * p[0] + ao[1] * p[1] + ao[2] * p[2]) * inverse;
+  if (u < 0 || u > 1) return false;
+  std::array<float, 3> q = { ao[1] * ab[2] - ao[2] * ab[1], ao[2] * ab[0] - ao[0] * ab[2], ao[0] * ab[1] - ao[1] * ab[0] };
+  float v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverse;
+  if (v < 0 || u + v > 1) return false;
+  float t = (ac[0] * q[0] + ac[1] * q[1] + ac[2] * q[2]) * inverse;
+  if (t <= 0) return false;
+  distance = t;
+  return true;
+}
+
+// the nearest face a ray ( in the mesh's coordinates ) hits closer than distance, which is then moved
+// up to it. goes through the mesh's bvh when it has one, otherwise every face
+bool raycastMesh(const Mesh& mesh, std::array<float, 3> origin, std::array<float, 3> direction, float& distance, int& face, bool useBvh) {
+  bool found = false;
+  float t;
+  if (!useBvh || mesh.bvh.nodes.empty()) {
+    for (int i = 0; i < mesh.getFaceCount(); ++i) {
+      if (intersectTriangle(mesh, i, origin, direction, t) && t < distance) {
+        distance = t;
+        face = i;
+        found = true;
+      }
+    }
+    return found;
+  }
+
+  std::array<float, 3> inverse = { 1 / direction[0], 1 / direction[1], 1 / direction[2] };
+  int stack[Bvh::STACK_SIZE];
+  int size = 0;
+  stack[size++] = 0;
+  while (size > 0) {
+    const BvhNode& node = mesh.bvh.nodes[stack[--size]];
+    if (getBoxEntry(node.bounds, origin, inverse, distance) >= distance) continue;
+    if (node.count > 0) {
+      for (int i = node.first; i < node.first + node.count; ++i) {
+        int item = mesh.bvh.items[i];
+        if (intersectTriangle(mesh, item, origin, direction, t) && t < distance) {
+          distance = t;
+          face = item;
+          found = true;
+        }
+      }
+      continue;
+    }
+    // the nearer child goes on top, so it is looked at first and can rule the other out
+    int near = node.first, far = node.first + 1;
+    float nearEntry = getBoxEntry(mesh.bvh.nodes[near].bounds, origin, inverse, distance);
+    float farEntry = getBoxEntry(mesh.bvh.nodes[far].bounds, origin, inverse, distance);
+    if (farEntry < nearEntry) {
+      std::swap(near, far);
+      std::swap(nearEntry, farEntry);
+    }
+    if (farEntry < distance) stack[size++] = far;
+    if (nearEntry < distance) stack[size++] = near;
+  }
+  return found;
+}
+
+// the box around a box once transformed
+static BoundingBox transformBox(const Matrix& matrix, const BoundingBox& box) {
+  BoundingBox transformed = getEmptyBox();
+  for (int corner = 0; corner < 8; ++corner) {
+    std::array<float, 3> point = { corner & 1 ? box.max[0] : box.min[0], corner & 2 ? box.max[1] : box.min[1], corner & 4 ? box.max[2] : box.min[2] };
+    growBox(transformed, transformVertex(matrix, point));
+  }
+  return transformed;
+}
+
+// whether a box is entirely behind one of the planes
+static bool isBoxOutside(const BoundingBox& box, const std::array<std::array<float, 4>, 5>& planes) {
+  for (const std::array<float, 4>& plane : planes) {
+    float distance = plane[3];
+    for (int i = 0; i < 3; ++i) distance += plane[i] * (plane[i] > 0 ? box.max[i] : box.min[i]);
+    if (distance < 0) return true;
+  }
+  return false;
+}
+
+// the box around a mesh and every simpler version of it, as any of them may be drawn
+static BoundingBox getMeshBox(const Mesh& mesh) {
+  BoundingBox box = mesh.bvh.nodes.empty() ? BoundingBox{ mesh.boundsMin, mesh.boundsMax } : mesh.bvh.nodes[0].bounds;
+  for (const Mesh& lod : mesh.lods) growBox(box, BoundingBox{ lod.boundsMin, lod.boundsMax });
+  return box;
+}
+
+// whether a box is entirely in front of every plane
+static bool isBoxInside(const BoundingBox& box, const std::array<std::array<float, 4>, 5>& planes) {
+  for (const std::array<float, 4>& plane : planes) {
+    float distance = plane[3];
+    for (int i = 0; i < 3; ++i) distance += plane[i] * (plane[i] > 0 ? box.min[i] : box.max[i]);
+    if (distance < 0) return false;
+  }
+  return true;
+}
+
+static const Mesh& getObjectMesh(const Scene& scene, const BvhObject& object) {
+  const SceneNode& node = scene.nodes[object.node];
+  return object.instance < 0 ? scene.models[node.model].mesh : scene.instancedModels[node.instanced].mesh;
+}
+
+// builds a bvh for every mesh that doesn't have one ( or has one for other faces ), then the top level
+// over where each model and instance is now. build again after adding nodes or changing a mesh
+void SceneBvh::build(Scene& scene) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (Model& model : scene.models) {
+    if (model.mesh.bvh.items.size() != model.mesh.getFaceCount()) model.mesh.buildBvh();
+  }
+  for (InstancedModel& instanced : scene.instancedModels) {
+    if (instanced.mesh.bvh.items.size() != instanced.mesh.getFaceCount()) instanced.mesh.buildBvh();
+  }
+  objects.clear();
+  updateObjects(scene);
+  top.build(boxes);
+  stats.objects = objects.size();
+  stats.triangles = 0;
+  for (const BvhObject& object : objects) stats.triangles += getObjectMesh(scene, object).getFaceCount();
+  stats.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// works out every node's world transform from the locals ( as Scene::updateTransforms does, without
+// changing the scene ) and updates the objects that moved, returning how many did. when the objects
+// are not the ones there were, they are made again from the start
+int SceneBvh::updateObjects(const Scene& scene) {
+  worlds.resize(scene.nodes.size());
+  int count = 0;
+  for (int i = 0; i < scene.nodes.size(); ++i) {
+    const SceneNode& node = scene.nodes[i];
+    worlds[i] = node.parent >= 0 ? multiplyMatrices(worlds[node.parent], node.local) : node.local;
+    if (node.model >= 0) count++;
+    if (node.instanced >= 0) count += scene.instancedModels[node.instanced].instances.size();
+  }
+  bool remake = count != objects.size();
+  if (remake) objects.clear();
+
+  int moved = 0;
+  int index = 0;
+  for (int i = 0; i < scene.nodes.size(); ++i) {
+    const SceneNode& node = scene.nodes[i];
+    int copies = node.instanced >= 0 ? scene.instancedModels[node.instanced].instances.size() : 0;
+    for (int instance = node.model >= 0 ? -1 : 0; instance < copies; ++instance) {
+      Matrix transform = instance < 0 ? worlds[i] : multiplyMatrices(worlds[i], scene.instancedModels[node.instanced].instances[instance].transform);
+      if (remake) objects.push_back(BvhObject{ i, instance, transform, invertMatrix(transform), {} });
+      BvhObject& object = objects[index++];
+      if (!remake && object.transform == transform) continue;
+      object.transform = transform;
+      object.inverse = invertMatrix(transform);
+      object.bounds = transformBox(transform, getMeshBox(getObjectMesh(scene, object)));
+      moved++;
+    }
+  }
+  boxes.resize(objects.size());
+  for (int i = 0; i < objects.size(); ++i) boxes[i] = objects[i].bounds;
+  return remake ? -1 : moved;
+}
+
+// catches the top level up with models and instances that moved, without touching their meshes.
+// rebuilds it if models or instances were added or taken away
+void SceneBvh::refit(const Scene& scene) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  int moved = updateObjects(scene);
+  if (moved < 0) top.build(boxes);
+  else if (moved > 0) top.refit(boxes);
+  stats.objects = objects.size();
+  stats.refitObjects = moved < 0 ? objects.size() : moved;
+  stats.refitMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the nearest face of any model or instance a ray in the world hits
+bool SceneBvh::raycast(const Scene& scene, std::array<float, 3> origin, std::array<float, 3> direction, RayHit& hit) const {
+  if (top.nodes.empty()) return false;
+  float distance = std::numeric_limits<float>::infinity();
+  bool found = false;
+  std::array<float, 3> inverse = { 1 / direction[0], 1 / direction[1], 1 / direction[2] };
+  int stack[Bvh::STACK_SIZE];
+  int size = 0;
+  stack[size++] = 0;
+  while (size > 0) {
+    const BvhNode& node = top.nodes[stack[--size]];
+    if (getBoxEntry(node.bounds, origin, inverse, distance) >= distance) continue;
+    if (node.count == 0) {
+      int near = node.first, far = node.first + 1;
+      float nearEntry = getBoxEntry(top.nodes[near].bounds, origin, inverse, distance);
+      float farEntry = getBoxEntry(top.nodes[far].bounds, origin, inverse, distance);
+      if (farEntry < nearEntry) {
+        std::swap(near, far);
+        std::swap(nearEntry, farEntry);
+      }
+      if (farEntry < distance) stack[size++] = far;
+      if (nearEntry < distance) stack[size++] = near;
+      continue;
+    }
+    for (int i = node.first; i < node.first + node.count; ++i) {
+      const BvhObject& object = objects[top.items[i]];
+      if (getBoxEntry(object.bounds, origin, inverse, distance) >= distance) continue;
+      // the same distance along the ray in the mesh's coordinates, as the direction is transformed with it
+      int face;
+      if (raycastMesh(getObjectMesh(scene, object), transformVertex(object.inverse, origin), rotateDirection(object.inverse, direction), distance, face)) {
+        hit = RayHit{ object.node, object.instance, face, distance, {} };
+        found = true;
+      }
+    }
+  }
+  if (found) {
+    for (int i = 0; i < 3; ++i) hit.point[i] = origin[i] + direction[i] * hit.distance;
+  }
+  return found;
+}
+
+// what the scene's camera sees in a cell of the screen ( column and row from the top left ), the ray
+// going from the camera through the cell's point at the focal length
+bool SceneBvh::pick(const Scene& scene, const Screen& screen, int column, int row, RayHit& hit) const {
+  float x = column - screen.width / 2, y = screen.height / 2 - row;
+  std::array<float, 3> cameraDirection = { x / scene.camera.focalLength, 1, y / scene.camera.focalLength };
+  // back into the world with the transpose of the view's rotation
+  Matrix view = scene.camera.getViewMatrix();
+  std::array<float, 3> direction;
+  for (int i = 0; i < 3; ++i) direction[i] = view[0][i] * cameraDirection[0] + view[1][i] * cameraDirection[1] + view[2][i] * cameraDirection[2];
+  return raycast(scene, scene.camera.position, direction, hit);
+}
+
+// whether any leaf of the mesh's bvh reaches inside every plane, with the planes taken into the mesh's
+// coordinates. tighter than the box around the whole mesh once it is turned. meshes with simpler
+// versions are always inside, as those can reach past the faces of the full one
+bool SceneBvh::isMeshInside(const Mesh& mesh, const Matrix& transform, const std::array<std::array<float, 4>, 5>& planes) const {
+  if (mesh.bvh.nodes.empty() || !mesh.lods.empty()) return true;
+  std::array<std::array<float, 4>, 5> meshPlanes;
+  for (int p = 0; p < 5; ++p) {
+    for (int i = 0; i < 3; ++i) meshPlanes[p][i] = planes[p][0] * transform[0][i] + planes[p][1] * transform[1][i] + planes[p][2] * transform[2][i];
+    meshPlanes[p][3] = planes[p][0] * transform[0][3] + planes[p][1] * transform[1][3] + planes[p][2] * transform[2][3] + planes[p][3];
+  }
+  int stack[Bvh::STACK_SIZE];
+  int size = 0;
+  stack[size++] = 0;
+  while (size > 0) {
+    const BvhNode& node = mesh.bvh.nodes[stack[--size]];
+    if (isBoxOutside(node.bounds, meshPlanes)) continue;
+    if (node.count > 0) return true;
+    stack[size++] = node.first;
+    stack[size++] = node.first + 1;
+  }
+  return false;
+}
+
+// finds the nodes with a model or instance that may be inside the planes ( unit normals and offsets in
+// the world, inside where >= 0, like Renderer::getWorldFrustum ), for isNodeVisible
+void SceneBvh::queryFrustum(const Scene& scene, const std::array<std::array<float, 4>, 5>& planes) {
+  visibleNodes.assign(scene.nodes.size(), 0);
+  if (top.nodes.empty()) return;
+  int stack[Bvh::STACK_SIZE];
+  int size = 0;
+  stack[size++] = 0;
+  while (size > 0) {
+    const BvhNode& node = top.nodes[stack[--size]];
+    if (isBoxOutside(node.bounds, planes)) continue;
+    if (node.count == 0) {
+      stack[size++] = node.first;
+      stack[size++] = node.first + 1;
+      continue;
+    }
+    for (int i = node.first; i < node.first + node.count; ++i) {
+      const BvhObject& object = objects[top.items[i]];
+      if (visibleNodes[object.node] || isBoxOutside(object.bounds, planes)) continue;
+      if (isBoxInside(object.bounds, planes) || isMeshInside(getObjectMesh(scene, object), object.transform, planes)) visibleNodes[object.node] = 1;
+    }
+  }
+}
+
+// whether a model or instance of the node was found by the last queryFrustum
+bool SceneBvh::isNodeVisible(int node) const {
+  return node < visibleNodes.size() && visibleNodes[node];
+}
+
+const std::vector<BvhObject>& SceneBvh::getObjects() const {
+  return objects;
+}
+
+const BvhStats& SceneBvh::getStats() const {
+  return stats;
+}
@@ -0,0 +1,29 @@
+#include <unistd.h>
+
+#include "renderer.hpp"
+
+// the thin viewer for renderer_demo --serve: connects to a unix socket path, or a tcp port on this
+// machine, and copies the stream it sends to the terminal until the server goes away
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    std::cerr << "usage: renderer_client path|port" << std::endl;
+    return 1;
+  }
+  int connection = connectToFrameServer(argv[1]);
+  if (connection < 0) {
+    std::cerr << "could not connect to " << argv[1] << std::endl;
+    return 1;
+  }
+
+  char buffer[64 * 1024];
+  ssize_t count;
+  while ((count = read(connection, buffer, sizeof(buffer))) > 0) {
+    for (ssize_t written = 0; written < count;) {
+      ssize_t step = write(STDOUT_FILENO, buffer + written, count - written);
+      if (step <= 0) return 1;
+      written += step;
+    }
+  }
+  close(connection);
+  return 0;
+}
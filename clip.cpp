@@ -0,0 +1,56 @@
+#include "renderer.hpp"
+
+// how far a camera space point is inside a clipping plane ( negative when outside ).
+// the guard band planes are where the projected x or y would reach +-GUARD_BAND.
+static float getPlaneDistance(int plane, std::array<float, 3> vertex, float nearPlane, float focalLength) {
+  switch (plane) {
+    case CLIP_NEAR:
+      return vertex[1] - nearPlane;
+    case CLIP_LEFT:
+      return vertex[0] * focalLength + GUARD_BAND * vertex[1];
+    case CLIP_RIGHT:
+      return GUARD_BAND * vertex[1] - vertex[0] * focalLength;
+    case CLIP_BOTTOM:
+      return vertex[2] * focalLength + GUARD_BAND * vertex[1];
+    default:
+      return GUARD_BAND * vertex[1] - vertex[2] * focalLength;
+  }
+}
+
+// which clipping planes a camera space point is outside of
+int getOutcode(std::array<float, 3> vertex, float nearPlane, int focalLength) {
+  int outcode = 0;
+  for (int plane = CLIP_NEAR; plane <= CLIP_TOP; plane <<= 1) {
+    if (getPlaneDistance(plane, vertex, nearPlane, focalLength) < 0) outcode |= plane;
+  }
+  return outcode;
+}
+
+// clips a camera space polygon against each plane in planes ( sutherland-hodgman ) and returns the
+// new number of vertices. each plane can add at most one vertex, so the polygon always fits.
+int clipPolygon(ClippedPolygon& polygon, int count, int planes, float nearPlane, int focalLength) {
+  ClippedPolygon input;
+  for (int plane = CLIP_NEAR; plane <= CLIP_TOP && count > 0; plane <<= 1) {
+    if (!(planes & plane)) continue;
+
+    input = polygon;
+    int inputCount = count;
+    count = 0;
+    for (int i = 0; i < inputCount; ++i) {
+      std::array<float, 3> start = input[i];
+      std::array<float, 3> end = input[(i + 1) % inputCount];
+      float startDistance = getPlaneDistance(plane, start, nearPlane, focalLength);
+      float endDistance = getPlaneDistance(plane, end, nearPlane, focalLength);
+
+      if (startDistance >= 0) polygon[count++] = start;
+      if ((startDistance >= 0) != (endDistance >= 0)) {
+        float t = startDistance / (startDistance - endDistance);
+        for (int j = 0; j < 3; ++j) {
+          polygon[count][j] = start[j] + t * (end[j] - start[j]);
+        }
+        count++;
+      }
+    }
+  }
+  return count;
+}
@@ -0,0 +1,145 @@
+#include "renderer.hpp"
+
+// unchanged cells between two changed ones are resent rather than skipped when the gap is this short
+const int MAX_RESENT_GAP = 4;
+
+FrameEncoder::FrameEncoder() {
+  width = 0;
+  height = 0;
+  hasPrevious = false;
+}
+
+// forces the next frame to be sent in full
+void FrameEncoder::reset() {
+  hasPrevious = false;
+}
+
+// writes a frame to the terminal with a single write
+void FrameEncoder::present(const Screen& screen) {
+  encode(screen);
+  write();
+}
+
+// writes the encoded output ( and anything appended to it since ) to the terminal
+void FrameEncoder::write() {
+#ifndef RENDERER_NO_PROFILE
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+  std::cout.write(output.data(), output.size());
+  std::cout.flush();
+#ifndef RENDERER_NO_PROFILE
+  if (profiler) {
+    profiler->addTime(STAGE_WRITE, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    profiler->addCount(COUNTER_BYTES_WRITTEN, output.size());
+  }
+#endif
+}
+
+// builds the output for a frame. the first frame (or one of a new size) clears the terminal and
+// sends every cell, after that only runs of cells that differ from the previous frame are sent.
+const std::string& FrameEncoder::encode(const Screen& screen) {
+#ifndef RENDERER_NO_PROFILE
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+  output.clear();
+  currentColour = 0;
+  output += "\033[0m";
+
+  if (!hasPrevious || screen.width != width || screen.height != height) {
+    width = screen.width;
+    height = screen.height;
+    previous = screen.buffer;
+    hasPrevious = true;
+
+    output += "\033[2J\033[H";
+    for (int row = 0; row < height; ++row) {
+      for (int column = 0; column < width; ++column) {
+        appendCell(screen.buffer[row * width + column]);
+      }
+      if (row < height - 1) output += "\r\n";
+    }
+  } else {
+    cursorRow = -1;
+    cursorColumn = -1;
+    for (int row = 0; row < height; ++row) {
+      const Cell* cells = &screen.buffer[row * width];
+      Cell* oldCells = &previous[row * width];
+
+      int column = 0;
+      while (column < width) {
+        if (sameCell(cells[column], oldCells[column])) {
+          column++;
+          continue;
+        }
+
+        // extend the run over short gaps of unchanged cells
+        int end = column + 1;
+        int lastChanged = column;
+        while (end < width && end - lastChanged <= MAX_RESENT_GAP) {
+          if (!sameCell(cells[end], oldCells[end])) lastChanged = end;
+          end++;
+        }
+
+        moveCursor(row, column);
+        for (int i = column; i <= lastChanged; ++i) {
+          appendCell(cells[i]);
+          oldCells[i] = cells[i];
+        }
+        cursorColumn = lastChanged + 1;
+        column = lastChanged + 1;
+      }
+    }
+  }
+
+  // leave the cursor on a cleared line below the frame
+  if (currentColour != 0) output += "\033[0m";
+  output += "\033[";
+  appendNumber(height + 1);
+  output += ";1H\033[K";
+#ifndef RENDERER_NO_PROFILE
+  if (profiler) profiler->addTime(STAGE_ENCODE, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+#endif
+  return output;
+}
+
+bool FrameEncoder::sameCell(Cell a, Cell b) {
+  return a.letter == b.letter && a.colour == b.colour;
+}
+
+// appends a cell, only changing colour when it differs from the previous cell written
+void FrameEncoder::appendCell(Cell cell) {
+  if (cell.colour != currentColour) {
+    if (cell.colour == 0) output += "\033[0m";
+    else output += getColourCode(cell.colour);
+    currentColour = cell.colour;
+  }
+  output += cell.letter;
+}
+
+// moves the cursor with the shortest escape available
+void FrameEncoder::moveCursor(int row, int column) {
+  if (row == cursorRow && column == cursorColumn) return;
+  if (row == cursorRow && column > cursorColumn) {
+    output += "\033[";
+    appendNumber(column - cursorColumn);
+    output += 'C';
+  } else {
+    output += "\033[";
+    appendNumber(row + 1);
+    output += ';';
+    appendNumber(column + 1);
+    output += 'H';
+  }
+  cursorRow = row;
+  cursorColumn = column;
+}
+
+void FrameEncoder::appendNumber(int number) {
+  char digits[12];
+  int length = 0;
+  do {
+    digits[length++] = '0' + number % 10;
+    number /= 10;
+  } while (number > 0);
+  while (length > 0) output += digits[--length];
+}
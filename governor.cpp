@@ -0,0 +1,162 @@
+#include "renderer.hpp"
+#include <cstdio>
+
+static const char* knobNames[KNOB_COUNT] = { "lod_bias", "lighting", "lights", "resolution" };
+static const char* lightingNames[] = { "smooth", "flat", "none" };
+
+// the settings each knob steps through, best first
+static const float lodBiases[] = { 1, 0.5f, 0.25f, 0.125f };
+static const LightingMode lightingModes[] = { LIGHTING_SMOOTH, LIGHTING_FLAT, LIGHTING_NONE };
+static const int lightCounts[] = { -1, 2, 1 };
+static const int resolutionScales[] = { 1, 2, 3 };
+
+// the stages quality makes a difference to, the rest ( encoding and writing ) are left out
+static const int governedStages[] = { STAGE_TRANSFORM, STAGE_SHADE, STAGE_BIN, STAGE_RASTER };
+
+// the knobs that take the most time off a stage, in the order they are tried
+static const QualityKnob knobOrders[][KNOB_COUNT] = {
+  { KNOB_LOD_BIAS, KNOB_LIGHTING, KNOB_LIGHTS, KNOB_RESOLUTION }, // transform
+  { KNOB_LIGHTING, KNOB_LIGHTS, KNOB_LOD_BIAS, KNOB_RESOLUTION }, // shade
+  { KNOB_LOD_BIAS, KNOB_RESOLUTION, KNOB_LIGHTING, KNOB_LIGHTS }, // bin
+  { KNOB_RESOLUTION, KNOB_LOD_BIAS, KNOB_LIGHTING, KNOB_LIGHTS }, // raster
+};
+
+// moves value one step along steps ( down is towards the end ), false if it is already at that end.
+// a value that isn't one of the steps counts as the first
+template <typename T, int N>
+static bool step(T& value, const T (&steps)[N], bool down) {
+  int i = 0;
+  while (i < N && steps[i] != value) i++;
+  if (i == N) i = 0;
+  int next = down ? i + 1 : i - 1;
+  if (next < 0 || next >= N) return false;
+  value = steps[next];
+  return true;
+}
+
+QualityGovernor::QualityGovernor(double frameBudgetMilliseconds) {
+  budgetMilliseconds = frameBudgetMilliseconds;
+  windowNext = 0;
+  windowCount = 0;
+  average = 0;
+  frame = 0;
+  lastChange = 0;
+  lastRaise = -1;
+  raiseWait = windowFrames;
+  lowered.reserve(16);
+  decisions.reserve(maxDecisions);
+}
+
+// takes the profile of the frame just drawn, and changes the settings if it is time to. true when they
+// changed, and the renderer should be given them
+bool QualityGovernor::update(const FrameProfile& profile) {
+  frame++;
+  if (window.size() != windowFrames) {
+    window.assign(std::max(1, windowFrames), FrameProfile{});
+    windowNext = 0;
+    windowCount = 0;
+  }
+  window[windowNext] = profile;
+  windowNext = (windowNext + 1) % window.size();
+  windowCount = std::min<int>(windowCount + 1, window.size());
+
+  std::array<double, 4> stages = {};
+  average = 0;
+  for (int i = 0; i < windowCount; ++i) {
+    for (int j = 0; j < 4; ++j) stages[j] += window[i].milliseconds[governedStages[j]] / windowCount;
+  }
+  int slowest = 0;
+  for (int j = 0; j < 4; ++j) {
+    average += stages[j];
+    if (stages[j] > stages[slowest]) slowest = j;
+  }
+  if (windowCount < window.size()) return false;
+
+  if (average > budgetMilliseconds) {
+    for (QualityKnob knob : knobOrders[slowest]) {
+      if (!lower(knob)) continue;
+      // raised only to be lowered again, so wait longer before trying that next time
+      if (lastRaise >= 0 && frame - lastRaise <= 2 * window.size()) raiseWait = std::min<int>(raiseWait * 2, 16 * window.size());
+      lowered.push_back(knob);
+      record(knob, true, governedStages[slowest]);
+      return true;
+    }
+  } else if (average < budgetMilliseconds * raiseBelow && !lowered.empty() && frame - lastChange >= raiseWait) {
+    QualityKnob knob = lowered.back();
+    lowered.pop_back();
+    raise(knob);
+    lastRaise = frame;
+    record(knob, false, governedStages[slowest]);
+    return true;
+  }
+  return false;
+}
+
+bool QualityGovernor::lower(QualityKnob knob) {
+  switch (knob) {
+    case KNOB_LOD_BIAS: return step(settings.lodBias, lodBiases, true);
+    case KNOB_LIGHTING: return step(settings.lighting, lightingModes, true);
+    case KNOB_LIGHTS: return step(settings.maxLights, lightCounts, true);
+    case KNOB_RESOLUTION: return step(settings.resolutionScale, resolutionScales, true);
+    default: return false;
+  }
+}
+
+bool QualityGovernor::raise(QualityKnob knob) {
+  switch (knob) {
+    case KNOB_LOD_BIAS: return step(settings.lodBias, lodBiases, false);
+    case KNOB_LIGHTING: return step(settings.lighting, lightingModes, false);
+    case KNOB_LIGHTS: return step(settings.maxLights, lightCounts, false);
+    case KNOB_RESOLUTION: return step(settings.resolutionScale, resolutionScales, false);
+    default: return false;
+  }
+}
+
+// keeps the decision, and starts the window again so the next one only sees frames drawn after it
+void QualityGovernor::record(QualityKnob knob, bool down, int stage) {
+  if (decisions.size() >= maxDecisions && !decisions.empty()) decisions.erase(decisions.begin());
+  decisions.push_back(QualityDecision{ frame, knob, down, average, stage });
+  lastChange = frame;
+  windowCount = 0;
+  windowNext = 0;
+}
+
+const QualitySettings& QualityGovernor::getSettings() const {
+  return settings;
+}
+
+// how many steps quality is down from the best
+int QualityGovernor::getLevel() const {
+  return lowered.size();
+}
+
+// the average time of the frames being watched, over the stages quality makes a difference to
+double QualityGovernor::getAverageMilliseconds() const {
+  return average;
+}
+
+// the most recent decisions, oldest first
+const std::vector<QualityDecision>& QualityGovernor::getDecisions() const {
+  return decisions;
+}
+
+const char* QualityGovernor::getKnobName(int knob) {
+  return knobNames[knob];
+}
+
+// adds a single line describing the settings and the last decision to output
+void QualityGovernor::appendSummary(std::string& output, const QualityGovernor& governor) {
+  const QualitySettings& settings = governor.settings;
+  char line[256];
+  int length = std::snprintf(line, sizeof(line), "quality %d steps down | %.2f of %.2f ms | scale %d lod %.3f lighting %s lights ",
+                             governor.getLevel(), governor.average, governor.budgetMilliseconds, settings.resolutionScale,
+                             settings.lodBias, lightingNames[settings.lighting]);
+  if (settings.maxLights < 0) length += std::snprintf(line + length, sizeof(line) - length, "all");
+  else length += std::snprintf(line + length, sizeof(line) - length, "%d", settings.maxLights);
+  if (!governor.decisions.empty()) {
+    const QualityDecision& last = governor.decisions.back();
+    std::snprintf(line + length, sizeof(line) - length, " | %s %s at frame %lld ( %s )", last.lowered ? "lowered" : "raised",
+                  knobNames[last.knob], last.frame, Profiler::getStageName(last.stage));
+  }
+  output += line;
+}
@@ -0,0 +1,371 @@
+#include <cstring>
+
+#include "renderer.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RENDERER_X86
+#endif
+
+// the reference kernel, every other kernel must give exactly the same results.
+// this relies on the compiler not fusing multiplies and adds in the scalar code, so builds
+// for cpus with fma ( e.g. -march=native ) need -ffp-contract=off
+static void transformVerticesScalar(const Matrix& matrix, int focalLength, const VertexBatch& batch, int first) {
+  for (int i = first; i < batch.count; ++i) {
+    std::array<float, 3> vertex = transformVertex(matrix, { batch.xs[i], batch.ys[i], batch.zs[i] });
+    std::array<int, 2> point = get2dPos(vertex, focalLength);
+    batch.cameraXs[i] = vertex[0];
+    batch.cameraYs[i] = vertex[1];
+    batch.cameraZs[i] = vertex[2];
+    batch.screenXs[i] = point[0];
+    batch.screenYs[i] = point[1];
+  }
+}
+
+static void transformVerticesScalar(const Matrix& matrix, int focalLength, const VertexBatch& batch) {
+  transformVerticesScalar(matrix, focalLength, batch, 0);
+}
+
+// how a light changes the shade of a surface, from the angle between the surface normal ( turned to
+// face the camera, so both sides are lit alike ) and the light, and the distance to the light. a made up formula kept from the
+// first renderer: the shade is multiplied by angle / (pi / 2) / strength * distance / 200, when that
+// is below 1. lights with no strength are skipped.
+static float getLightScale(float strength) {
+  return 2 / PI / (strength * 200);
+}
+
+// abramowitz and stegun 4.4.46, within 2e-8 of acos over [-1, 1] and easy to vectorise
+static float getArcCosine(float x) {
+  float a = std::fabs(x);
+  a = a < 1 ? a : 1;
+  float polynomial = ((((((-0.0012624911f * a + 0.0066700901f) * a - 0.0170881256f) * a + 0.0308918810f) * a - 0.0501743046f) * a + 0.0889789874f) * a - 0.2145988016f) * a + 1.5707963050f;
+  float angle = std::sqrt(1 - a) * polynomial;
+  return x < 0 ? PI - angle : angle;
+}
+
+static void lightSurfacesScalar(const std::vector<std::array<float, 4>>& lightSources, const LightBatch& batch, int first) {
+  for (int i = first; i < batch.count; ++i) {
+    float nx = batch.normalXs[i], ny = batch.normalYs[i], nz = batch.normalZs[i];
+    float px = batch.pointXs[i], py = batch.pointYs[i], pz = batch.pointZs[i];
+    float normalLength = std::sqrt(nx * nx + ny * ny + nz * nz);
+    bool facingAway = nx * px + ny * py + nz * pz > 0;
+    float shade = 1;
+    for (const std::array<float, 4>& lightSource : lightSources) {
+      if (lightSource[3] == 0) continue;
+      float lx = lightSource[0] - px;
+      float ly = lightSource[1] - py;
+      float lz = lightSource[2] - pz;
+      float dot = nx * lx + ny * ly + nz * lz;
+      if (facingAway) dot = -dot;
+      float lightLength = std::sqrt(lx * lx + ly * ly + lz * lz);
+      float change = getArcCosine(dot / (normalLength * lightLength)) * lightLength * getLightScale(lightSource[3]);
+      shade *= change < 1 ? change : 1;
+    }
+    batch.shades[i] = shade;
+  }
+}
+
+static void lightSurfacesScalar(const std::vector<std::array<float, 4>>& lightSources, const LightBatch& batch) {
+  lightSurfacesScalar(lightSources, batch, 0);
+}
+
+#ifdef RENDERER_X86
+// 4 vertices at a time. the operations are done in the same order as transformVertex and get2dPos
+// (and without fused multiply-adds) so that the results match the scalar kernel exactly.
+static void transformVerticesSSE2(const Matrix& matrix, int focalLength, const VertexBatch& batch) {
+  __m128 m[3][4];
+  for (int row = 0; row < 3; ++row) {
+    for (int column = 0; column < 4; ++column) m[row][column] = _mm_set1_ps(matrix[row][column]);
+  }
+  __m128 zero = _mm_setzero_ps();
+  __m128 focal = _mm_set1_ps((float)focalLength);
+
+  int i = 0;
+  for (; i + 4 <= batch.count; i += 4) {
+    __m128 x = _mm_loadu_ps(batch.xs + i);
+    __m128 y = _mm_loadu_ps(batch.ys + i);
+    __m128 z = _mm_loadu_ps(batch.zs + i);
+    __m128 camera[3];
+    for (int row = 0; row < 3; ++row) {
+      camera[row] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[row][0], x), _mm_mul_ps(m[row][1], y)), _mm_mul_ps(m[row][2], z)), m[row][3]);
+    }
+
+    // points at or behind the camera are only scaled, the rest are divided by their depth
+    __m128 behind = _mm_cmple_ps(camera[1], zero);
+    __m128 depth = _mm_sub_ps(zero, camera[1]);
+    __m128 projectedX = _mm_div_ps(_mm_mul_ps(_mm_sub_ps(zero, camera[0]), focal), depth);
+    __m128 projectedY = _mm_div_ps(_mm_mul_ps(_mm_sub_ps(zero, camera[2]), focal), depth);
+    projectedX = _mm_or_ps(_mm_and_ps(behind, _mm_mul_ps(camera[0], focal)), _mm_andnot_ps(behind, projectedX));
+    projectedY = _mm_or_ps(_mm_and_ps(behind, _mm_mul_ps(camera[2], focal)), _mm_andnot_ps(behind, projectedY));
+
+    _mm_storeu_ps(batch.cameraXs + i, camera[0]);
+    _mm_storeu_ps(batch.cameraYs + i, camera[1]);
+    _mm_storeu_ps(batch.cameraZs + i, camera[2]);
+    _mm_storeu_si128((__m128i*)(batch.screenXs + i), _mm_cvttps_epi32(projectedX));
+    _mm_storeu_si128((__m128i*)(batch.screenYs + i), _mm_cvttps_epi32(projectedY));
+  }
+  transformVerticesScalar(matrix, focalLength, batch, i);
+}
+
+static __m128 getArcCosineSSE2(__m128 x) {
+  __m128 signBit = _mm_set1_ps(-0.0f);
+  __m128 one = _mm_set1_ps(1);
+  __m128 a = _mm_min_ps(_mm_andnot_ps(signBit, x), one);
+  __m128 polynomial = _mm_set1_ps(-0.0012624911f);
+  const float coefficients[7] = { 0.0066700901f, -0.0170881256f, 0.0308918810f, -0.0501743046f, 0.0889789874f, -0.2145988016f, 1.5707963050f };
+  for (float coefficient : coefficients) polynomial = _mm_add_ps(_mm_mul_ps(polynomial, a), _mm_set1_ps(coefficient));
+  __m128 angle = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(one, a)), polynomial);
+  __m128 negative = _mm_cmplt_ps(x, _mm_setzero_ps());
+  return _mm_or_ps(_mm_and_ps(negative, _mm_sub_ps(_mm_set1_ps(PI), angle)), _mm_andnot_ps(negative, angle));
+}
+
+// 4 surfaces at a time, in the same order as the scalar kernel
+static void lightSurfacesSSE2(const std::vector<std::array<float, 4>>& lightSources, const LightBatch& batch) {
+  __m128 signBit = _mm_set1_ps(-0.0f);
+  __m128 one = _mm_set1_ps(1);
+  int i = 0;
+  for (; i + 4 <= batch.count; i += 4) {
+    __m128 nx = _mm_loadu_ps(batch.normalXs + i);
+    __m128 ny = _mm_loadu_ps(batch.normalYs + i);
+    __m128 nz = _mm_loadu_ps(batch.normalZs + i);
+    __m128 px = _mm_loadu_ps(batch.pointXs + i);
+    __m128 py = _mm_loadu_ps(batch.pointYs + i);
+    __m128 pz = _mm_loadu_ps(batch.pointZs + i);
+    __m128 normalLength = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+    __m128 facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, px), _mm_mul_ps(ny, py)), _mm_mul_ps(nz, pz));
+    __m128 flip = _mm_and_ps(_mm_cmpgt_ps(facing, _mm_setzero_ps()), signBit);
+    __m128 shade = one;
+    for (const std::array<float, 4>& lightSource : lightSources) {
+      if (lightSource[3] == 0) continue;
+      __m128 lx = _mm_sub_ps(_mm_set1_ps(lightSource[0]), px);
+      __m128 ly = _mm_sub_ps(_mm_set1_ps(lightSource[1]), py);
+      __m128 lz = _mm_sub_ps(_mm_set1_ps(lightSource[2]), pz);
+      __m128 dot = _mm_xor_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, lx), _mm_mul_ps(ny, ly)), _mm_mul_ps(nz, lz)), flip);
+      __m128 lightLength = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz)));
+      __m128 angle = getArcCosineSSE2(_mm_div_ps(dot, _mm_mul_ps(normalLength, lightLength)));
+      __m128 change = _mm_mul_ps(_mm_mul_ps(angle, lightLength), _mm_set1_ps(getLightScale(lightSource[3])));
+      shade = _mm_mul_ps(shade, _mm_min_ps(change, one));
+    }
+    _mm_storeu_ps(batch.shades + i, shade);
+  }
+  lightSurfacesScalar(lightSources, batch, i);
+}
+
+// 8 vertices at a time, otherwise the same as the sse2 kernel
+__attribute__((target("avx2")))
+static void transformVerticesAVX2(const Matrix& matrix, int focalLength, const VertexBatch& batch) {
+  __m256 m[3][4];
+  for (int row = 0; row < 3; ++row) {
+    for (int column = 0; column < 4; ++column) m[row][column] = _mm256_set1_ps(matrix[row][column]);
+  }
+  __m256 zero = _mm256_setzero_ps();
+  __m256 focal = _mm256_set1_ps((float)focalLength);
+
+  int i = 0;
+  for (; i + 8 <= batch.count; i += 8) {
+    __m256 x = _mm256_loadu_ps(batch.xs + i);
+    __m256 y = _mm256_loadu_ps(batch.ys + i);
+    __m256 z = _mm256_loadu_ps(batch.zs + i);
+    __m256 camera[3];
+    for (int row = 0; row < 3; ++row) {
+      camera[row] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[row][0], x), _mm256_mul_ps(m[row][1], y)), _mm256_mul_ps(m[row][2], z)), m[row][3]);
+    }
+
+    __m256 behind = _mm256_cmp_ps(camera[1], zero, _CMP_LE_OQ);
+    __m256 depth = _mm256_sub_ps(zero, camera[1]);
+    __m256 projectedX = _mm256_div_ps(_mm256_mul_ps(_mm256_sub_ps(zero, camera[0]), focal), depth);
+    __m256 projectedY = _mm256_div_ps(_mm256_mul_ps(_mm256_sub_ps(zero, camera[2]), focal), depth);
+    projectedX = _mm256_blendv_ps(projectedX, _mm256_mul_ps(camera[0], focal), behind);
+    projectedY = _mm256_blendv_ps(projectedY, _mm256_mul_ps(camera[2], focal), behind);
+
+    _mm256_storeu_ps(batch.cameraXs + i, camera[0]);
+    _mm256_storeu_ps(batch.cameraYs + i, camera[1]);
+    _mm256_storeu_ps(batch.cameraZs + i, camera[2]);
+    _mm256_storeu_si256((__m256i*)(batch.screenXs + i), _mm256_cvttps_epi32(projectedX));
+    _mm256_storeu_si256((__m256i*)(batch.screenYs + i), _mm256_cvttps_epi32(projectedY));
+  }
+  transformVerticesScalar(matrix, focalLength, batch, i);
+}
+
+__attribute__((target("avx2")))
+static __m256 getArcCosineAVX2(__m256 x) {
+  __m256 signBit = _mm256_set1_ps(-0.0f);
+  __m256 one = _mm256_set1_ps(1);
+  __m256 a = _mm256_min_ps(_mm256_andnot_ps(signBit, x), one);
+  __m256 polynomial = _mm256_set1_ps(-0.0012624911f);
+  const float coefficients[7] = { 0.0066700901f, -0.0170881256f, 0.0308918810f, -0.0501743046f, 0.0889789874f, -0.2145988016f, 1.5707963050f };
+  for (float coefficient : coefficients) polynomial = _mm256_add_ps(_mm256_mul_ps(polynomial, a), _mm256_set1_ps(coefficient));
+  __m256 angle = _mm256_mul_ps(_mm256_sqrt_ps(_mm256_sub_ps(one, a)), polynomial);
+  __m256 negative = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ);
+  return _mm256_blendv_ps(angle, _mm256_sub_ps(_mm256_set1_ps(PI), angle), negative);
+}
+
+// 8 surfaces at a time, otherwise the same as the sse2 kernel
+__attribute__((target("avx2")))
+static void lightSurfacesAVX2(const std::vector<std::array<float, 4>>& lightSources, const LightBatch& batch) {
+  __m256 signBit = _mm256_set1_ps(-0.0f);
+  __m256 one = _mm256_set1_ps(1);
+  int i = 0;
+  for (; i + 8 <= batch.count; i += 8) {
+    __m256 nx = _mm256_loadu_ps(batch.normalXs + i);
+    __m256 ny = _mm256_loadu_ps(batch.normalYs + i);
+    __m256 nz = _mm256_loadu_ps(batch.normalZs + i);
+    __m256 px = _mm256_loadu_ps(batch.pointXs + i);
+    __m256 py = _mm256_loadu_ps(batch.pointYs + i);
+    __m256 pz = _mm256_loadu_ps(batch.pointZs + i);
+    __m256 normalLength = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz)));
+    __m256 facing = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, px), _mm256_mul_ps(ny, py)), _mm256_mul_ps(nz, pz));
+    __m256 flip = _mm256_and_ps(_mm256_cmp_ps(facing, _mm256_setzero_ps(), _CMP_GT_OQ), signBit);
+    __m256 shade = one;
+    for (const std::array<float, 4>& lightSource : lightSources) {
+      if (lightSource[3] == 0) continue;
+      __m256 lx = _mm256_sub_ps(_mm256_set1_ps(lightSource[0]), px);
+      __m256 ly = _mm256_sub_ps(_mm256_set1_ps(lightSource[1]), py);
+      __m256 lz = _mm256_sub_ps(_mm256_set1_ps(lightSource[2]), pz);
+      __m256 dot = _mm256_xor_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, lx), _mm256_mul_ps(ny, ly)), _mm256_mul_ps(nz, lz)), flip);
+      __m256 lightLength = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)), _mm256_mul_ps(lz, lz)));
+      __m256 angle = getArcCosineAVX2(_mm256_div_ps(dot, _mm256_mul_ps(normalLength, lightLength)));
+      __m256 change = _mm256_mul_ps(_mm256_mul_ps(angle, lightLength), _mm256_set1_ps(getLightScale(lightSource[3])));
+      shade = _mm256_mul_ps(shade, _mm256_min_ps(change, one));
+    }
+    _mm256_storeu_ps(batch.shades + i, shade);
+  }
+  lightSurfacesScalar(lightSources, batch, i);
+}
+#endif
+
+// a set of kernels for one instruction set
+struct VertexKernel {
+  const char* name;
+  void (*function)(const Matrix&, int, const VertexBatch&);
+  void (*light)(const std::vector<std::array<float, 4>>&, const LightBatch&);
+  bool (*isSupported)();
+};
+
+static bool alwaysSupported() {
+  return true;
+}
+
+#ifdef RENDERER_X86
+static bool supportsAVX2() {
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+// fastest first
+static const VertexKernel vertexKernels[] = {
+#ifdef RENDERER_X86
+  { "avx2", transformVerticesAVX2, lightSurfacesAVX2, supportsAVX2 },
+  { "sse2", transformVerticesSSE2, lightSurfacesSSE2, alwaysSupported },
+#endif
+  { "scalar", transformVerticesScalar, lightSurfacesScalar, alwaysSupported },
+};
+
+static const VertexKernel* selectVertexKernel() {
+  for (const VertexKernel& kernel : vertexKernels) {
+    if (kernel.isSupported()) return &kernel;
+  }
+  return nullptr;
+}
+
+static const VertexKernel* vertexKernel = selectVertexKernel();
+
+// moves a batch of vertices into camera space and projects them onto the screen, using the
+// fastest kernel the cpu supports
+void transformVertices(const Matrix& matrix, int focalLength, const VertexBatch& batch) {
+  vertexKernel->function(matrix, focalLength, batch);
+}
+
+// works out the shade of a batch of surfaces lit by lightSources ( positions in camera space and
+// strengths ), with the same kernel set as transformVertices
+void lightSurfaces(const std::vector<std::array<float, 4>>& lightSources, const LightBatch& batch) {
+  vertexKernel->light(lightSources, batch);
+}
+
+const char* getVertexKernelName() {
+  return vertexKernel->name;
+}
+
+// picks a kernel by name, returns false if it is unknown or the cpu does not support it
+bool setVertexKernel(std::string name) {
+  for (const VertexKernel& kernel : vertexKernels) {
+    if (kernel.name == name && kernel.isSupported()) {
+      vertexKernel = &kernel;
+      return true;
+    }
+  }
+  return false;
+}
+
+// runs every supported kernel set over awkward input ( points behind, on and just in front of the
+// camera, large coordinates and a count that is not a multiple of the vector width ) and checks
+// that each gives exactly the same output as the scalar kernel
+bool checkVertexKernels() {
+  const int count = 1003;
+  std::vector<float> xs(count), ys(count), zs(count);
+  unsigned int seed = 12345;
+  auto random = [&](float range) {
+    seed = seed * 1664525 + 1013904223;
+    return ((seed >> 8) / (float)(1 << 24) * 2 - 1) * range;
+  };
+  for (int i = 0; i < count; ++i) {
+    xs[i] = random(i % 7 == 0 ? 1e5f : 300);
+    ys[i] = random(i % 5 == 0 ? 0.01f : 400);
+    zs[i] = random(300);
+  }
+  ys[0] = 0;
+  ys[1] = -0.0f;
+  ys[2] = 200;
+
+  Matrix matrix = multiplyMatrices(getTranslationMatrix(3, 200, -7), getRotationMatrix(0.3f, -1.1f, 2.5f));
+
+  auto run = [&](const VertexKernel& kernel, std::vector<float>& cameraValues, std::vector<int>& screenValues) {
+    cameraValues.assign(count * 3, 0);
+    screenValues.assign(count * 2, 0);
+    VertexBatch batch = { xs.data(), ys.data(), zs.data(), &cameraValues[0], &cameraValues[count], &cameraValues[count * 2], &screenValues[0], &screenValues[count], count };
+    kernel.function(matrix, 100, batch);
+  };
+
+  // surfaces facing every way ( including exactly sideways and degenerate ) lit from near and far
+  std::vector<float> normals(count * 3);
+  for (int i = 0; i < count * 3; ++i) normals[i] = random(1);
+  normals[count] = 0;
+  normals[count + 1] = -0.0f;
+  normals[2] = normals[count + 2] = normals[count * 2 + 2] = 0;
+  std::vector<std::array<float, 4>> lightSources = { { 0, -400, 0, 10 }, { 2000, 0, 0, 0 }, { -50, 30, 200, 0.5f }, { 1, 2, 3, 1e-3f } };
+
+  auto runLight = [&](const VertexKernel& kernel, std::vector<float>& shades) {
+    shades.assign(count, 0);
+    LightBatch batch = { &normals[0], &normals[count], &normals[count * 2], xs.data(), ys.data(), zs.data(), shades.data(), count };
+    kernel.light(lightSources, batch);
+  };
+
+  std::vector<float> expectedCamera, camera;
+  std::vector<int> expectedScreen, screen;
+  std::vector<float> expectedShades, shades;
+  run(vertexKernels[sizeof(vertexKernels) / sizeof(vertexKernels[0]) - 1], expectedCamera, expectedScreen);
+  runLight(vertexKernels[sizeof(vertexKernels) / sizeof(vertexKernels[0]) - 1], expectedShades);
+
+  bool passed = true;
+  for (const VertexKernel& kernel : vertexKernels) {
+    if (!kernel.isSupported()) {
+      std::cout << kernel.name << ": not supported" << std::endl;
+      continue;
+    }
+    run(kernel, camera, screen);
+    int mismatches = 0;
+    for (int i = 0; i < count * 3; ++i) {
+      if (std::memcmp(&camera[i], &expectedCamera[i], sizeof(float)) != 0) mismatches++;
+    }
+    for (int i = 0; i < count * 2; ++i) {
+      if (screen[i] != expectedScreen[i]) mismatches++;
+    }
+    runLight(kernel, shades);
+    for (int i = 0; i < count; ++i) {
+      if (std::memcmp(&shades[i], &expectedShades[i], sizeof(float)) != 0) mismatches++;
+    }
+    std::cout << kernel.name << ": " << (mismatches == 0 ? "ok" : std::to_string(mismatches) + " mismatches") << std::endl;
+    if (mismatches != 0) passed = false;
+  }
+  return passed;
+}
@@ -0,0 +1,376 @@
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "renderer.hpp"
+
+// a whole file mapped read only, unmapped when it goes out of scope
+class MappedFile {
+public:
+  const char* data = nullptr;
+  size_t size = 0;
+
+  MappedFile(const std::string& path) {
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) return;
+    struct stat status;
+    if (fstat(file, &status) == 0 && status.st_size > 0) {
+      void* mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+      if (mapping != MAP_FAILED) {
+        data = (const char*)mapping;
+        size = status.st_size;
+        madvise(mapping, size, MADV_SEQUENTIAL);
+      }
+    }
+    close(file);
+  }
+
+  ~MappedFile() {
+    if (data) munmap((void*)data, size);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+};
+
+// finds vertices at exactly the same position, so a triangle soup becomes an indexed mesh.
+// an open addressing table of vertex indices, hashed on the bits of the position.
+class VertexWelder {
+public:
+  VertexWelder(Mesh& weldedMesh, int expectedVertices) : mesh(weldedMesh) {
+    int capacity = 1024;
+    while (capacity < expectedVertices * 2) capacity *= 2;
+    slots.assign(capacity, -1);
+  }
+
+  int add(float x, float y, float z) {
+    // -0 and 0 are the same position
+    x += 0.0f;
+    y += 0.0f;
+    z += 0.0f;
+    unsigned mask = slots.size() - 1;
+    for (unsigned slot = getHash(x, y, z) & mask;; slot = (slot + 1) & mask) {
+      int index = slots[slot];
+      if (index < 0) {
+        slots[slot] = mesh.addVertex({ x, y, z });
+        if (mesh.getVertexCount() * 2 > slots.size()) grow();
+        return mesh.getVertexCount() - 1;
+      }
+      if (mesh.xs[index] == x && mesh.ys[index] == y && mesh.zs[index] == z) return index;
+    }
+  }
+
+private:
+  Mesh& mesh;
+  std::vector<int> slots;
+
+  static unsigned getHash(float x, float y, float z) {
+    uint32_t bits[3];
+    std::memcpy(&bits[0], &x, 4);
+    std::memcpy(&bits[1], &y, 4);
+    std::memcpy(&bits[2], &z, 4);
+    uint64_t hash = bits[0] * 0x9e3779b97f4a7c15ULL;
+    hash = (hash ^ bits[1]) * 0x9e3779b97f4a7c15ULL;
+    hash = (hash ^ bits[2]) * 0x9e3779b97f4a7c15ULL;
+    return hash >> 32;
+  }
+
+  void grow() {
+    slots.assign(slots.size() * 2, -1);
+    unsigned mask = slots.size() - 1;
+    for (int index = 0; index < mesh.getVertexCount(); ++index) {
+      unsigned slot = getHash(mesh.xs[index], mesh.ys[index], mesh.zs[index]) & mask;
+      while (slots[slot] >= 0) slot = (slot + 1) & mask;
+      slots[slot] = index;
+    }
+  }
+};
+
+static bool isSpace(char letter) {
+  return letter == ' ' || letter == '\t';
+}
+
+static const char* skipSpaces(const char* position, const char* end) {
+  while (position < end && isSpace(*position)) position++;
+  return position;
+}
+
+static const char* skipLine(const char* position, const char* end) {
+  const char* newline = (const char*)std::memchr(position, '\n', end - position);
+  return newline ? newline + 1 : end;
+}
+
+// reads a wavefront obj straight from the mapped file. only positions and faces are used, faces with
+// more than three corners are split into a fan and positions repeated in the file are welded together.
+bool loadObj(const std::string& path, Mesh& mesh, std::vector<char>& letters, std::string colour) {
+  mesh = Mesh();
+  MappedFile file(path);
+  if (!file.data) return false;
+
+  const char* position = file.data;
+  const char* end = file.data + file.size;
+  VertexWelder welder(mesh, file.size / 64);
+  std::vector<int> objVertices; // mesh vertex of every v line
+  int material = getMaterialId(letters, colour);
+  std::vector<int> corners;
+
+  while (position < end) {
+    position = skipSpaces(position, end);
+    if (end - position > 1 && position[0] == 'v' && isSpace(position[1])) {
+      float vertex[3] = { 0, 0, 0 };
+      position += 2;
+      for (int i = 0; i < 3; ++i) {
+        position = skipSpaces(position, end);
+        std::from_chars_result result = std::from_chars(position, end, vertex[i]);
+        if (result.ec != std::errc()) return false;
+        position = result.ptr;
+      }
+      objVertices.push_back(welder.add(vertex[0], vertex[1], vertex[2]));
+    } else if (end - position > 1 && position[0] == 'f' && isSpace(position[1])) {
+      corners.clear();
+      position += 2;
+      while (true) {
+        position = skipSpaces(position, end);
+        if (position >= end || *position == '\n' || *position == '\r' || *position == '#') break;
+        int index = 0;
+        std::from_chars_result result = std::from_chars(position, end, index);
+        if (result.ec != std::errc()) return false;
+        // negative indices count back from the latest vertex
+        index = index < 0 ? objVertices.size() + index : index - 1;
+        if (index < 0 || index >= objVertices.size()) return false;
+        corners.push_back(objVertices[index]);
+        // skip the texture and normal indices
+        position = result.ptr;
+        while (position < end && !isSpace(*position) && *position != '\n' && *position != '\r') position++;
+      }
+      for (int i = 1; i + 1 < corners.size(); ++i) mesh.addFace(corners[0], corners[i], corners[i + 1], material);
+    }
+    position = skipLine(position, end);
+  }
+
+  mesh.updateBounds();
+  return true;
+}
+
+// reads a binary stl, an 80 byte header and a count followed by 50 bytes per triangle
+bool loadStl(const std::string& path, Mesh& mesh, std::vector<char>& letters, std::string colour) {
+  mesh = Mesh();
+  MappedFile file(path);
+  if (!file.data || file.size < 84) return false;
+
+  uint32_t triangleCount;
+  std::memcpy(&triangleCount, file.data + 80, 4);
+  if (file.size != 84 + (size_t)triangleCount * 50) return false; // ascii, or cut short
+
+  VertexWelder welder(mesh, triangleCount / 2 + 1);
+  int material = getMaterialId(letters, colour);
+  mesh.indices.reserve((size_t)triangleCount * 3);
+  mesh.faceMaterials.reserve(triangleCount);
+  for (uint32_t triangle = 0; triangle < triangleCount; ++triangle) {
+    float corners[9];
+    std::memcpy(corners, file.data + 84 + (size_t)triangle * 50 + 12, sizeof(corners)); // after the normal
+    int a = welder.add(corners[0], corners[1], corners[2]);
+    int b = welder.add(corners[3], corners[4], corners[5]);
+    int c = welder.add(corners[6], corners[7], corners[8]);
+    mesh.addFace(a, b, c, material);
+  }
+
+  mesh.updateBounds();
+  return true;
+}
+
+// the native format is laid out like a mesh in memory ( in the machine's byte order ), so loading it
+// is a few copies out of the mapping. the header is followed by xs, ys and zs, the indices, the face
+// materials ( padded to four bytes ) and then the materials they use. face materials in the file
+// index that list, and become material ids again when loaded. the mesh's simpler versions come last,
+// each a vertex and face count and then its arrays laid out the same way.
+const char MESH_CACHE_MAGIC[8] = { 'R', 'N', 'D', 'M', 'E', 'S', 'H', '3' };
+
+struct MeshCacheHeader {
+  char magic[8];
+  uint32_t vertexCount;
+  uint32_t faceCount;
+  uint32_t materialCount;
+  uint32_t closed;
+  float boundsMin[3];
+  float boundsMax[3];
+  float boundsCentre[3];
+  float boundsRadius;
+  uint32_t lodCount;
+};
+
+// writes the vertex, index and face material arrays of a mesh, with materials numbered as the file numbers them
+static void writeMeshArrays(std::ofstream& file, const Mesh& mesh, const std::vector<int>& fileMaterials) {
+  std::vector<unsigned short> faceMaterials(mesh.getFaceCount());
+  for (int face = 0; face < mesh.getFaceCount(); ++face) faceMaterials[face] = fileMaterials[mesh.faceMaterials[face]];
+  file.write((const char*)mesh.xs.data(), mesh.xs.size() * sizeof(float));
+  file.write((const char*)mesh.ys.data(), mesh.ys.size() * sizeof(float));
+  file.write((const char*)mesh.zs.data(), mesh.zs.size() * sizeof(float));
+  file.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(int));
+  file.write((const char*)faceMaterials.data(), faceMaterials.size() * sizeof(unsigned short));
+  if (faceMaterials.size() % 2) file.write("\0\0", 2);
+}
+
+// copies the arrays written by writeMeshArrays out of the mapping, false if the file is too short
+static bool readMeshArrays(const MappedFile& file, size_t& offset, uint32_t vertexCount, uint32_t faceCount, Mesh& mesh) {
+  size_t vertexBytes = (size_t)vertexCount * sizeof(float);
+  size_t indexBytes = (size_t)faceCount * 3 * sizeof(int);
+  size_t materialBytes = ((size_t)faceCount * sizeof(unsigned short) + 3) / 4 * 4;
+  if (file.size < offset + vertexBytes * 3 + indexBytes + materialBytes) return false;
+
+  const float* xs = (const float*)(file.data + offset);
+  const float* ys = xs + vertexCount;
+  const float* zs = ys + vertexCount;
+  mesh.xs.assign(xs, xs + vertexCount);
+  mesh.ys.assign(ys, ys + vertexCount);
+  mesh.zs.assign(zs, zs + vertexCount);
+  offset += vertexBytes * 3;
+
+  const int* indices = (const int*)(file.data + offset);
+  mesh.indices.assign(indices, indices + (size_t)faceCount * 3);
+  offset += indexBytes;
+
+  const unsigned short* faceMaterials = (const unsigned short*)(file.data + offset);
+  mesh.faceMaterials.assign(faceMaterials, faceMaterials + faceCount);
+  offset += materialBytes;
+  return true;
+}
+
+// never trust indices from a file: every index must be a vertex, and every face material one of ids
+static bool checkMeshArrays(Mesh& mesh, const std::vector<unsigned short>& ids) {
+  for (int index : mesh.indices) {
+    if (index < 0 || index >= mesh.getVertexCount()) return false;
+  }
+  for (unsigned short& material : mesh.faceMaterials) {
+    if (material >= ids.size()) return false;
+    material = ids[material];
+  }
+  return true;
+}
+
+bool saveMeshCache(const std::string& path, const Mesh& mesh) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file) return false;
+
+  // number the materials the mesh uses from 0, the simpler versions only use ones it does
+  std::vector<int> fileMaterials(getMaterialCount(), -1);
+  std::vector<unsigned short> usedMaterials;
+  for (unsigned short id : mesh.faceMaterials) {
+    if (fileMaterials[id] < 0) {
+      fileMaterials[id] = usedMaterials.size();
+      usedMaterials.push_back(id);
+    }
+  }
+
+  MeshCacheHeader header = {};
+  std::memcpy(header.magic, MESH_CACHE_MAGIC, 8);
+  header.vertexCount = mesh.getVertexCount();
+  header.faceCount = mesh.getFaceCount();
+  header.materialCount = usedMaterials.size();
+  header.closed = mesh.closed;
+  for (int i = 0; i < 3; ++i) {
+    header.boundsMin[i] = mesh.boundsMin[i];
+    header.boundsMax[i] = mesh.boundsMax[i];
+    header.boundsCentre[i] = mesh.boundsCentre[i];
+  }
+  header.boundsRadius = mesh.boundsRadius;
+  header.lodCount = mesh.lods.size();
+  file.write((const char*)&header, sizeof(header));
+  writeMeshArrays(file, mesh, fileMaterials);
+
+  for (unsigned short id : usedMaterials) {
+    const Material& material = getMaterial(id);
+    const std::string& colour = getColourCode(material.colour);
+    uint32_t lengths[3] = { (uint32_t)material.letters.size(), (uint32_t)colour.size(), material.smooth };
+    file.write((const char*)lengths, sizeof(lengths));
+    file.write(material.letters.data(), material.letters.size());
+    file.write(colour.data(), colour.size());
+  }
+
+  for (const Mesh& lod : mesh.lods) {
+    uint32_t counts[2] = { (uint32_t)lod.getVertexCount(), (uint32_t)lod.getFaceCount() };
+    file.write((const char*)counts, sizeof(counts));
+    writeMeshArrays(file, lod, fileMaterials);
+  }
+  return (bool)file;
+}
+
+bool loadMeshCache(const std::string& path, Mesh& mesh) {
+  mesh = Mesh();
+  MappedFile file(path);
+  if (!file.data || file.size < sizeof(MeshCacheHeader)) return false;
+
+  MeshCacheHeader header;
+  std::memcpy(&header, file.data, sizeof(header));
+  if (std::memcmp(header.magic, MESH_CACHE_MAGIC, 8) != 0) return false;
+
+  size_t offset = sizeof(header);
+  if (!readMeshArrays(file, offset, header.vertexCount, header.faceCount, mesh)) return false;
+
+  std::vector<unsigned short> ids;
+  for (uint32_t i = 0; i < header.materialCount; ++i) {
+    uint32_t lengths[3];
+    if (file.size < offset + sizeof(lengths)) return false;
+    std::memcpy(lengths, file.data + offset, sizeof(lengths));
+    offset += sizeof(lengths);
+    if (file.size < offset + lengths[0] + lengths[1]) return false;
+    std::vector<char> letters(file.data + offset, file.data + offset + lengths[0]);
+    std::string colour(file.data + offset + lengths[0], lengths[1]);
+    offset += lengths[0] + lengths[1];
+    ids.push_back(getMaterialId(letters, colour, lengths[2] != 0));
+  }
+
+  bool valid = checkMeshArrays(mesh, ids);
+  for (uint32_t i = 0; i < header.lodCount && valid; ++i) {
+    uint32_t counts[2];
+    if (file.size < offset + sizeof(counts)) {
+      valid = false;
+      break;
+    }
+    std::memcpy(counts, file.data + offset, sizeof(counts));
+    offset += sizeof(counts);
+    Mesh lod;
+    valid = readMeshArrays(file, offset, counts[0], counts[1], lod) && checkMeshArrays(lod, ids);
+    if (!valid) break;
+    lod.closed = header.closed;
+    lod.updateBounds();
+    lod.updateNormals();
+    mesh.lods.push_back(std::move(lod));
+  }
+  if (!valid) {
+    mesh = Mesh();
+    return false;
+  }
+
+  mesh.closed = header.closed;
+  for (int i = 0; i < 3; ++i) {
+    mesh.boundsMin[i] = header.boundsMin[i];
+    mesh.boundsMax[i] = header.boundsMax[i];
+    mesh.boundsCentre[i] = header.boundsCentre[i];
+  }
+  mesh.boundsRadius = header.boundsRadius;
+  return true;
+}
+
+static bool hasExtension(const std::string& path, const std::string& extension) {
+  if (path.size() < extension.size()) return false;
+  for (int i = 0; i < extension.size(); ++i) {
+    if (std::tolower(path[path.size() - extension.size() + i]) != extension[i]) return false;
+  }
+  return true;
+}
+
+// loads an .obj, .stl or native .mesh file, choosing by the extension. letters and colour are
+// used for the faces of obj and stl files, native files keep their own materials.
+bool loadMesh(const std::string& path, Mesh& mesh, std::vector<char>& letters, std::string colour) {
+  if (hasExtension(path, ".obj")) return loadObj(path, mesh, letters, colour);
+  if (hasExtension(path, ".stl")) return loadStl(path, mesh, letters, colour);
+  if (hasExtension(path, ".mesh")) return loadMeshCache(path, mesh);
+  return false;
+}
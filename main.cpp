@@ -1,192 +1,180 @@
 #include <thread>
 #include <chrono>
+#include <fstream>
+#include <cstdio>
 
 #include "renderer.hpp"
 
-void clearScreen() {
-  std::cout << "\033[2J\033[1;1H";
-}
+int main(int argc, char** argv) {
+  int width = 200;
+  int height = 80;
+  Screen mainScreen = Screen(width, height);
 
-class Model {
-public:
-  std::vector<Triangle> faces;
-  // initialise triangles
-  Model(std::vector<std::array<std::array<float,3>,3>> sides, std::vector<char>& fillLetters, std::vector<std::string>& colours) {
-    for (int i = 0; i < sides.size(); ++i) {
-      Triangle trig(sides[i], fillLetters, colours[i]);
-      faces.push_back(trig);
+  // --threads n sets how many threads fill the screen ( defaults to one per core )
+  // --check compares the vectorised kernels against the scalar ones and exits
+  // --hud shows the last frame's profile under the fps
+  // --stats path appends the average profile of every second to a file ( json lines if it ends in .json, otherwise csv )
+  // --drop-late skips the frames whose time has already passed instead of catching up on them
+  // --model path shows an .obj, .stl or .mesh file instead of the cubes
+  // --smooth lights every vertex and blends across faces, instead of lighting each face once
+  // --latest lets a new frame replace one still waiting to be written, instead of waiting for it
+  // --incremental only redraws the parts of the screen that changed since the last frame
+  // --serve path|port renders for any number of renderer_client viewers on a unix socket or a local tcp
+  // port, instead of drawing to this terminal
+  // --budget ms lowers quality ( resolution, level of detail, lighting ) while drawing a frame takes longer
+  // than ms and raises it again once there is room, 0 keeps full quality ( defaults to a frame at 30 fps )
+  // --batch n draws n frames of the animation as fast as it can instead, on every thread at once, and
+  // writes them to --output path ( stdout unless given ) as --format ansi, cells or ppm ( ansi unless given )
+  int threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+  bool showHud = false;
+  bool dropLate = false;
+  bool smooth = false;
+  bool incremental = false;
+  PresentPolicy policy = PRESENT_EVERY_FRAME;
+  std::string statsPath;
+  std::string modelPath;
+  std::string serveAddress;
+  double budget = -1;
+  int batchFrames = 0;
+  std::string outputPath;
+  BatchFormat batchFormat = BATCH_ANSI;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument = argv[i];
+    if (argument == "--threads" && i + 1 < argc) threadCount = std::max(1, std::atoi(argv[++i]));
+    if (argument == "--check") return checkVertexKernels() ? 0 : 1;
+    if (argument == "--hud") showHud = true;
+    if (argument == "--stats" && i + 1 < argc) statsPath = argv[++i];
+    if (argument == "--drop-late") dropLate = true;
+    if (argument == "--smooth") smooth = true;
+    if (argument == "--latest") policy = PRESENT_LATEST;
+    if (argument == "--incremental") incremental = true;
+    if (argument == "--model" && i + 1 < argc) modelPath = argv[++i];
+    if (argument == "--serve" && i + 1 < argc) serveAddress = argv[++i];
+    if (argument == "--budget" && i + 1 < argc) budget = std::max(0.0, std::atof(argv[++i]));
+    if (argument == "--batch" && i + 1 < argc) batchFrames = std::max(1, std::atoi(argv[++i]));
+    if (argument == "--output" && i + 1 < argc) outputPath = argv[++i];
+    if (argument == "--format" && i + 1 < argc && !getBatchFormat(argv[++i], batchFormat)) {
+      std::cerr << "unknown format " << argv[i] << std::endl;
+      return 1;
     }
   }
-
-  // rotate each triangle by the rotation angles ( in rad )
-  void rotate(float yaw, float pitch, float roll) {
-    for (int i = 0; i < faces.size(); ++i) {
-      Triangle face = faces[i];
-      face.rotate(yaw, pitch, roll);
-      faces[i] = face;
+  Renderer renderer(threadCount);
+
+  std::ofstream statsFile;
+  bool statsJson = statsPath.size() >= 5 && statsPath.compare(statsPath.size() - 5, 5, ".json") == 0;
+  if (!statsPath.empty()) {
+    statsFile.open(statsPath);
+    if (!statsFile) {
+      std::cerr << "could not open " << statsPath << std::endl;
+      return 1;
     }
+    if (!statsJson) Profiler::writeCsvHeader(statsFile);
   }
 
-  // translate each triangle by the translation vector
-  void translate(float x, float y, float z) {
-    for (int i = 0; i < faces.size(); ++i) {
-      Triangle face = faces[i];
-      face.translate(x, y, z);
-      faces[i] = face;
+  Scene scene = makeDemoScene();
+  if (!modelPath.empty()) {
+    Mesh mesh;
+    if (!loadMesh(modelPath, mesh, defaultLetters, "\033[36m")) {
+      std::cerr << "could not load " << modelPath << std::endl;
+      return 1;
     }
+    if (mesh.lods.empty()) mesh.buildLods();
+    scene = makeMeshScene(std::move(mesh));
+  }
+  if (smooth) {
+    for (Model& model : scene.models) model.mesh.setSmooth(true);
+    for (InstancedModel& instanced : scene.instancedModels) instanced.mesh.setSmooth(true);
   }
 
-  // draw each triangle to the screen buffer
-  void draw(Screen& screen, std::array<float,3> cameraPos, std::array<float,3> cameraRot, int focalLength, std::vector<std::array<float,4>> lightSources) {
-    for (int i = 0; i < faces.size(); ++i) {
-      faces[i].draw(screen, cameraPos, cameraRot, focalLength, lightSources);
+  if (batchFrames > 0) {
+    std::ofstream outputFile;
+    if (!outputPath.empty() && outputPath != "-") {
+      outputFile.open(outputPath, std::ios::binary);
+      if (!outputFile) {
+        std::cerr << "could not open " << outputPath << std::endl;
+        return 1;
+      }
     }
+    std::ostream& output = outputFile.is_open() ? outputFile : std::cout;
+    BatchStats stats = renderBatch(scene, makeSpinTimeline(scene, batchFrames), width, height, threadCount, batchFormat, output);
+    std::cerr << stats.frames << " frames, " << stats.bytes << " bytes in " << stats.milliseconds / 1000 << " s ( "
+              << stats.frames * 1000 / std::max(0.001, stats.milliseconds) << " frames/sec on " << threadCount << " threads )" << std::endl;
+    return stats.frames == batchFrames ? 0 : 1;
   }
-};
-
-// /*
-Model makeCube(std::array<float, 3> centre, float sideLength, std::vector<char>& letters, std::vector<std::string>& colours) {
-  // create a cube
-  std::array<std::array<float, 3>, 3> face;
-
-  std::vector<std::array<std::array<float,3>,3>> faces;
-
-  std::array<float,3> c1 = {sideLength + centre[0], sideLength + centre[1], sideLength + centre[2]};
-  std::array<float,3> c2 = {-sideLength + centre[0], sideLength + centre[1], sideLength + centre[2]};
-  std::array<float,3> c3 = {sideLength + centre[0], -sideLength + centre[1], sideLength + centre[2]};
-  std::array<float,3> c4 = {-sideLength + centre[0], -sideLength + centre[1], sideLength + centre[2]};
-  std::array<float,3> c5 = {sideLength + centre[0], sideLength + centre[1], -sideLength + centre[2]};
-  std::array<float,3> c6 = {-sideLength + centre[0], sideLength + centre[1], -sideLength + centre[2]};
-  std::array<float,3> c7 = {sideLength + centre[0], -sideLength + centre[1], -sideLength + centre[2]};
-  std::array<float,3> c8 = {-sideLength + centre[0], -sideLength + centre[1], -sideLength + centre[2]};
-
-  face = {c1, c2, c3};
-  faces.push_back(face);
-  face = {c2, c3, c4};
-  faces.push_back(face);
-  face = {c1, c2, c6};
-  faces.push_back(face);
-  face = {c1, c5, c6};
-  faces.push_back(face);
-  face = {c1, c3, c7};
-  faces.push_back(face);
-  face = {c1, c5, c7};
-  faces.push_back(face);
-  face = {c3, c4, c8};
-  faces.push_back(face);
-  face = {c3, c7, c8};
-  faces.push_back(face);
-  face = {c2, c4, c8};
-  faces.push_back(face);
-  face = {c2, c6, c8};
-  faces.push_back(face);
-  face = {c5, c7, c8};
-  faces.push_back(face);
-  face = {c5, c6, c8};
-  faces.push_back(face);
-
-  Model cube(faces, letters, colours);
-
-  return cube;
-}
-
-// */
 
-int main() {
-  int width = 200;
-  int height = 80;
-  Screen mainScreen = Screen(width, height);
-
-  std::vector<Model> models;
-
-  // set up light source and camera position and fps
-  int focalLength = 100;
-  std::array<float, 3> cameraPos = {0, -200, 0};
-  std::array<float, 3> cameraRot = {0, 0, 0};
   float fps = 30;
+  if (budget < 0) budget = 1000 / fps;
+  QualityGovernor governor(budget);
+
+  FrameServer server;
+  if (!serveAddress.empty()) {
+    if (!server.listen(serveAddress)) {
+      std::cerr << "could not listen on " << serveAddress << std::endl;
+      return 1;
+    }
+    std::cerr << "serving on " << serveAddress << ", view with renderer_client " << serveAddress << std::endl;
+  }
 
-  std::array<float, 4> lightSource = { 0, -400, 0, 10 };
-  std::array<float, 4> lightSource2 = { 2000, 0, 0, 0 };
-  std::vector<std::array<float,4>> lightSources = { lightSource, lightSource2 };
-
-  std::vector<char> letters = {'@', '%', '#', '*', '+', '=', '-', ':', '.'};
-  // std::vector<char> letters = {'$', '@', 'B', '%', '8', '&', 'W', 'M', '#', '*', 'o', 'a', 'h', 'k', 'b', 'd', 'p', 'q', 'w', 'm', 'Z', 'O', '0', 'Q', 'L', 'C', 'J', 'U', 'Y', 'X', 'z', 'c', 'v', 'u', 'n', 'x', 'r', 'j', 'f', 't', '/', '\\', '|', '(', ')', '1', '{', '}', '[', ']', '?', '-', '_', '+', '~', '<', '>', 'i', '!', 'l', 'I', ';', ':', ',', '\"', '^', '`', '\'', '.'};
-  std::vector<std::string> colours = {"\033[31m", "\033[31m", "\033[32m", "\033[32m", "\033[33m", "\033[33m", "\033[34m", "\033[34m", "\033[35m", "\033[35m", "\033[36m", "\033[36m"};
-  std::vector<std::string> colours2 = {"\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m"};
-
-  float sideLength = 20;
-  std::array<float, 3> centre = { -40, 0, 0 };
-  Model cube = makeCube(centre, sideLength, letters, colours);
-
-  sideLength = 30;
-  std::array<float, 3> centre2 = { 80, 0, 0 };
-  Model cube2 = makeCube(centre2, sideLength, letters, colours2);
-
-  sideLength = 25;
-  std::array<float, 3> centre3 = { 0, 60, 0 };
-  Model cube3 = makeCube(centre3, sideLength, letters, colours);
-
-  sideLength = 25;
-  std::array<float, 3> centre4 = { 0, 0, 0 };
-  Model cube4 = makeCube(centre4, sideLength, letters, colours);
-
-  models.push_back(cube);
-  models.push_back(cube2);
-  models.push_back(cube3);
-  // models.push_back(cube4);
-
-  int frameTime = 1000 / fps;
-  std::vector<int> previousFrameTimes;
+  // the next frame is drawn while the presenter writes the last one, so a frame takes as long as
+  // the slower of the two rather than both added together
+  FrameScheduler scheduler(fps, dropLate);
+  FramePresenter presenter(policy);
+  renderer.setIncremental(incremental);
+  presenter.copyScreens = incremental;
+  std::vector<double> previousFrameTimes;
+  std::vector<double> previousPresentTimes;
+  std::string footer;
 
   while (1) {
-    auto start = std::chrono::system_clock::now();
-    // render loop
-    mainScreen.emptyBuffer();
-    mainScreen.emptyZBuffer();
-
-    for (int i = 0; i < models.size(); ++i) {
-      Model model = models[i];
-
-      switch (i) {
-        case 0:
-          model.rotate(0, 0, 0.04);
-          break;
-        case 1:
-          model.rotate(0, 0.02, 0);
-          break;
-        case 2:
-          model.rotate(0.06, 0, 0);
-          break;
-      }
-
-      // model.rotate(0, 0.01, 0);
-      // model.translate(0, -2, 0);
-      model.draw(mainScreen, cameraPos, cameraRot, focalLength, lightSources);
-
-      models[i] = model;
-    }
+    scheduler.waitForNextFrame();
 
-    auto end = std::chrono::system_clock::now();
+    auto start = std::chrono::steady_clock::now();
+    scene.update();
+    scene.draw(renderer, mainScreen);
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 
-    auto duration = end.time_since_epoch() - start.time_since_epoch();
-    int milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
-
-    int wait = frameTime - milliseconds;
-    if (wait > 0) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(wait));
-    }
+    // output time of whatever was written since the last frame
+    FrameProfile presented = presenter.takeProfile();
+    renderer.profiler.addProfile(presented);
+    double presentMilliseconds = presented.milliseconds[STAGE_ENCODE] + presented.milliseconds[STAGE_WRITE];
 
     previousFrameTimes.push_back(milliseconds);
-    if (previousFrameTimes.size() > fps) previousFrameTimes.erase(previousFrameTimes.begin());
-
-    int total = 0;
-    for (int milliseconds : previousFrameTimes) total += milliseconds;
-    int average = total / previousFrameTimes.size();
-
+    previousPresentTimes.push_back(presentMilliseconds);
+    if (previousFrameTimes.size() > fps) {
+      previousFrameTimes.erase(previousFrameTimes.begin());
+      previousPresentTimes.erase(previousPresentTimes.begin());
+    }
 
-    clearScreen();
-    mainScreen.drawBuffer();
-    std::cout << "Max FPS: " << (int)(1000/average) << std::endl;
+    double total = 0;
+    double presentTotal = 0;
+    for (int i = 0; i < previousFrameTimes.size(); ++i) {
+      total += previousFrameTimes[i];
+      presentTotal += previousPresentTimes[i];
+    }
+    double average = std::max(0.001, std::max(total, presentTotal) / previousFrameTimes.size());
+
+    // built in place so the steady state loop does not allocate
+    PresenterStats stats = presenter.getStats();
+    char status[128];
+    std::snprintf(status, sizeof(status), "Max FPS: %d  missed %d dropped %d replaced %d  quality -%d\033[K\r\n", (int)(1000 / average),
+                  scheduler.getMissedFrames(), scheduler.getDroppedFrames(), stats.replaced, governor.getLevel());
+    footer = status;
+    if (showHud) {
+      Profiler::appendSummary(footer, renderer.profiler.getLastFrame());
+      footer += "\033[K\r\n";
+      QualityGovernor::appendSummary(footer, governor);
+      footer += "\033[K\r\n";
+    }
+    if (serveAddress.empty()) presenter.submit(mainScreen, footer);
+    else server.broadcast(mainScreen);
+
+    renderer.profiler.endFrame();
+    if (budget > 0 && governor.update(renderer.profiler.getLastFrame())) renderer.setQuality(governor.getSettings());
+    if (statsFile.is_open() && renderer.profiler.getAverageFrameCount() >= fps) {
+      if (statsJson) Profiler::writeJson(statsFile, renderer.profiler.getAverage());
+      else Profiler::writeCsv(statsFile, renderer.profiler.getAverage());
+      renderer.profiler.resetAverage();
+    }
   }
 
   return 0;
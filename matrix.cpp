@@ -0,0 +1,98 @@
+#include "renderer.hpp"
+
+Matrix getIdentityMatrix() {
+  return Matrix{ { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } } };
+}
+
+// rotation by yaw ( about z ), pitch ( about y ) and roll ( about x ), applied roll first
+Matrix getRotationMatrix(float yaw, float pitch, float roll) {
+  float cosYaw = std::cos(yaw), sinYaw = std::sin(yaw);
+  float cosPitch = std::cos(pitch), sinPitch = std::sin(pitch);
+  float cosRoll = std::cos(roll), sinRoll = std::sin(roll);
+
+  Matrix matrix;
+  matrix[0] = { cosYaw * cosPitch, cosYaw * sinPitch * sinRoll - sinYaw * cosRoll, cosYaw * sinPitch * cosRoll + sinYaw * sinRoll, 0 };
+  matrix[1] = { sinYaw * cosPitch, sinYaw * sinPitch * sinRoll + cosYaw * cosRoll, sinYaw * sinPitch * cosRoll - cosYaw * sinRoll, 0 };
+  matrix[2] = { -sinPitch, cosPitch * sinRoll, cosPitch * cosRoll, 0 };
+  return matrix;
+}
+
+Matrix getTranslationMatrix(float x, float y, float z) {
+  Matrix matrix = getIdentityMatrix();
+  matrix[0][3] = x;
+  matrix[1][3] = y;
+  matrix[2][3] = z;
+  return matrix;
+}
+
+// the transform that applies b and then a
+Matrix multiplyMatrices(const Matrix& a, const Matrix& b) {
+  Matrix product;
+  for (int row = 0; row < 3; ++row) {
+    for (int column = 0; column < 4; ++column) {
+      product[row][column] = a[row][0] * b[0][column] + a[row][1] * b[1][column] + a[row][2] * b[2][column];
+    }
+    product[row][3] += a[row][3];
+  }
+  return product;
+}
+
+std::array<float, 3> transformVertex(const Matrix& matrix, std::array<float, 3> vertex) {
+  std::array<float, 3> newVertex;
+  for (int row = 0; row < 3; ++row) {
+    newVertex[row] = matrix[row][0] * vertex[0] + matrix[row][1] * vertex[1] + matrix[row][2] * vertex[2] + matrix[row][3];
+  }
+  return newVertex;
+}
+
+// rotates a direction, ignoring the translation
+std::array<float, 3> rotateDirection(const Matrix& matrix, std::array<float, 3> direction) {
+  std::array<float, 3> newDirection;
+  for (int row = 0; row < 3; ++row) {
+    newDirection[row] = matrix[row][0] * direction[0] + matrix[row][1] * direction[1] + matrix[row][2] * direction[2];
+  }
+  return newDirection;
+}
+
+// the most the matrix stretches any direction by, for growing bounding spheres ( the longest column )
+float getScale(const Matrix& matrix) {
+  float largest = 0;
+  for (int column = 0; column < 3; ++column) {
+    largest = std::max(largest, matrix[0][column] * matrix[0][column] + matrix[1][column] * matrix[1][column] + matrix[2][column] * matrix[2][column]);
+  }
+  return std::sqrt(largest);
+}
+
+// makes the rotation part of a matrix orthonormal again (gram-schmidt on the rows), so
+// that repeatedly composing small rotations does not slowly scale or shear a model
+void orthonormalise(Matrix& matrix) {
+  for (int row = 0; row < 3; ++row) {
+    for (int previous = 0; previous < row; ++previous) {
+      float dot = 0;
+      for (int i = 0; i < 3; ++i) dot += matrix[row][i] * matrix[previous][i];
+      for (int i = 0; i < 3; ++i) matrix[row][i] -= dot * matrix[previous][i];
+    }
+    float length = std::sqrt(matrix[row][0] * matrix[row][0] + matrix[row][1] * matrix[row][1] + matrix[row][2] * matrix[row][2]);
+    for (int i = 0; i < 3; ++i) matrix[row][i] /= length;
+  }
+}
+
+// the transform that undoes matrix, which must not flatten anything
+Matrix invertMatrix(const Matrix& matrix) {
+  const Matrix& m = matrix;
+  float determinant = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                      m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                      m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+  Matrix inverse;
+  inverse[0] = { m[1][1] * m[2][2] - m[1][2] * m[2][1], m[0][2] * m[2][1] - m[0][1] * m[2][2], m[0][1] * m[1][2] - m[0][2] * m[1][1], 0 };
+  inverse[1] = { m[1][2] * m[2][0] - m[1][0] * m[2][2], m[0][0] * m[2][2] - m[0][2] * m[2][0], m[0][2] * m[1][0] - m[0][0] * m[1][2], 0 };
+  inverse[2] = { m[1][0] * m[2][1] - m[1][1] * m[2][0], m[0][1] * m[2][0] - m[0][0] * m[2][1], m[0][0] * m[1][1] - m[0][1] * m[1][0], 0 };
+  for (int row = 0; row < 3; ++row) {
+    for (int column = 0; column < 3; ++column) inverse[row][column] /= determinant;
+  }
+  // then the translation, undone in the new coordinates
+  for (int row = 0; row < 3; ++row) {
+    inverse[row][3] = -(inverse[row][0] * m[0][3] + inverse[row][1] * m[1][3] + inverse[row][2] * m[2][3]);
+  }
+  return inverse;
+}
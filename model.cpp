@@ -0,0 +1,185 @@
+#include <map>
+#include <deque>
+
+#include "renderer.hpp"
+
+// every material in use. a deque, so materials never move and triangles can point at their letters.
+static std::deque<Material> materials;
+
+// finds (or adds) the material with these letters, colour and shading
+unsigned short getMaterialId(const std::vector<char>& letters, const std::string& colour, bool smooth) {
+  unsigned char colourIndex = getColourIndex(colour);
+  for (int i = 0; i < materials.size(); ++i) {
+    if (materials[i].colour == colourIndex && materials[i].smooth == smooth && materials[i].letters == letters) return i;
+  }
+  if (materials.size() > std::numeric_limits<unsigned short>::max()) return 0;
+  materials.push_back(Material{ letters, colourIndex, smooth });
+  return materials.size() - 1;
+}
+
+const Material& getMaterial(unsigned short id) {
+  return materials[id];
+}
+
+int getMaterialCount() {
+  return materials.size();
+}
+
+int Mesh::getVertexCount() const {
+  return xs.size();
+}
+
+int Mesh::getFaceCount() const {
+  return faceMaterials.size();
+}
+
+int Mesh::addVertex(std::array<float, 3> vertex) {
+  xs.push_back(vertex[0]);
+  ys.push_back(vertex[1]);
+  zs.push_back(vertex[2]);
+  return xs.size() - 1;
+}
+
+void Mesh::addFace(int a, int b, int c, int material) {
+  indices.push_back(a);
+  indices.push_back(b);
+  indices.push_back(c);
+  faceMaterials.push_back(material);
+}
+
+// finds the box around the vertices and a sphere around that box
+void Mesh::updateBounds() {
+  if (xs.empty()) return;
+  boundsMin = { xs[0], ys[0], zs[0] };
+  boundsMax = boundsMin;
+  for (int i = 1; i < getVertexCount(); ++i) {
+    std::array<float, 3> vertex = { xs[i], ys[i], zs[i] };
+    for (int j = 0; j < 3; ++j) {
+      boundsMin[j] = std::min(boundsMin[j], vertex[j]);
+      boundsMax[j] = std::max(boundsMax[j], vertex[j]);
+    }
+  }
+
+  float radiusSquared = 0;
+  for (int j = 0; j < 3; ++j) boundsCentre[j] = (boundsMin[j] + boundsMax[j]) / 2;
+  for (int i = 0; i < getVertexCount(); ++i) {
+    float dx = xs[i] - boundsCentre[0], dy = ys[i] - boundsCentre[1], dz = zs[i] - boundsCentre[2];
+    radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+  }
+  boundsRadius = std::sqrt(radiusSquared);
+}
+
+// finds the unit normal of every face ( anticlockwise corners face towards the viewer ) and of every
+// vertex. only needed again when the vertices or faces change, not when the mesh is moved.
+void Mesh::updateNormals() {
+  int faceCount = getFaceCount();
+  int vertexCount = getVertexCount();
+  faceNormalXs.assign(faceCount, 0);
+  faceNormalYs.assign(faceCount, 0);
+  faceNormalZs.assign(faceCount, 0);
+  vertexNormalXs.assign(vertexCount, 0);
+  vertexNormalYs.assign(vertexCount, 0);
+  vertexNormalZs.assign(vertexCount, 0);
+
+  for (int face = 0; face < faceCount; ++face) {
+    int a = indices[face * 3], b = indices[face * 3 + 1], c = indices[face * 3 + 2];
+    std::array<float, 3> ab = { xs[b] - xs[a], ys[b] - ys[a], zs[b] - zs[a] };
+    std::array<float, 3> ac = { xs[c] - xs[a], ys[c] - ys[a], zs[c] - zs[a] };
+    std::array<float, 3> normal = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+
+    // the unnormalised normal is as long as twice the area, which weights the vertex normals
+    for (int corner : { a, b, c }) {
+      vertexNormalXs[corner] += normal[0];
+      vertexNormalYs[corner] += normal[1];
+      vertexNormalZs[corner] += normal[2];
+    }
+
+    float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if (length > 0) {
+      faceNormalXs[face] = normal[0] / length;
+      faceNormalYs[face] = normal[1] / length;
+      faceNormalZs[face] = normal[2] / length;
+    }
+  }
+
+  for (int vertex = 0; vertex < vertexCount; ++vertex) {
+    float length = std::sqrt(vertexNormalXs[vertex] * vertexNormalXs[vertex] + vertexNormalYs[vertex] * vertexNormalYs[vertex] + vertexNormalZs[vertex] * vertexNormalZs[vertex]);
+    if (length > 0) {
+      vertexNormalXs[vertex] /= length;
+      vertexNormalYs[vertex] /= length;
+      vertexNormalZs[vertex] /= length;
+    }
+  }
+}
+
+// moves and scales the vertices so the bounding sphere is centred on the origin with this radius
+void Mesh::fit(float radius) {
+  updateBounds();
+  float scale = boundsRadius > 0 ? radius / boundsRadius : 1;
+  for (int i = 0; i < getVertexCount(); ++i) {
+    xs[i] = (xs[i] - boundsCentre[0]) * scale;
+    ys[i] = (ys[i] - boundsCentre[1]) * scale;
+    zs[i] = (zs[i] - boundsCentre[2]) * scale;
+  }
+  // the simpler versions move with it, so they still line up
+  for (Mesh& lod : lods) {
+    for (int i = 0; i < lod.getVertexCount(); ++i) {
+      lod.xs[i] = (lod.xs[i] - boundsCentre[0]) * scale;
+      lod.ys[i] = (lod.ys[i] - boundsCentre[1]) * scale;
+      lod.zs[i] = (lod.zs[i] - boundsCentre[2]) * scale;
+    }
+    lod.updateBounds();
+  }
+  updateBounds();
+}
+
+// shades the mesh and its simpler versions smoothly, or as their materials say
+void Mesh::setSmooth(bool enabled) {
+  smooth = enabled;
+  for (Mesh& lod : lods) lod.smooth = enabled;
+}
+
+Model::Model(Mesh modelMesh) {
+  mesh = std::move(modelMesh);
+  mesh.updateBounds();
+  mesh.updateNormals();
+  transform = getIdentityMatrix();
+}
+
+// initialise from separate triangles, corners at the same position become one shared vertex
+Model::Model(std::vector<std::array<std::array<float,3>,3>> sides, std::vector<char>& fillLetters, std::vector<std::string>& colours) {
+  transform = getIdentityMatrix();
+  std::map<std::array<float, 3>, int> vertexIndices;
+  for (int i = 0; i < sides.size(); ++i) {
+    std::array<int, 3> corners;
+    for (int j = 0; j < 3; ++j) {
+      auto found = vertexIndices.find(sides[i][j]);
+      if (found == vertexIndices.end()) {
+        corners[j] = mesh.addVertex(sides[i][j]);
+        vertexIndices[sides[i][j]] = corners[j];
+      } else {
+        corners[j] = found->second;
+      }
+    }
+    mesh.addFace(corners[0], corners[1], corners[2], getMaterialId(fillLetters, colours[i]));
+  }
+  mesh.updateBounds();
+  mesh.updateNormals();
+}
+
+// rotate the model about the origin by the rotation angles ( in rad ), the vertices themselves are left alone
+void Model::rotate(float yaw, float pitch, float roll) {
+  transform = multiplyMatrices(getRotationMatrix(yaw, pitch, roll), transform);
+  orthonormalise(transform);
+}
+
+// translate the model by the translation vector
+void Model::translate(float x, float y, float z) {
+  transform[0][3] += x;
+  transform[1][3] += y;
+  transform[2][3] += z;
+}
+
+void Model::draw(Renderer& renderer) {
+  renderer.drawMesh(mesh, transform);
+}
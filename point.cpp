@@ -15,94 +15,3 @@ std::array<int, 2> get2dPos(std::array<float, 3> pos, int focalLength) {
   }
   return newPos;
 }
-
-// uses the Bresenham line algorithm to find the points on a 2d screen which a 2d line goes through.
-// it also records the depth of each point for the zbuffer
-std::tuple<std::vector<std::array<int,2>>, std::vector<float>> getPoints(Screen& screen, std::array<int, 2> startPos, float startDepth, std::array<int, 2> endPos, float endDepth) {
-  std::vector<std::array<int,2>> points;
-  std::vector<float> depths;
-
-  int axis;
-  float gradient = (float)(startPos[1] - endPos[1]) / (float)(startPos[0] - endPos[0]);
-
-  if (gradient < -1 || gradient > 1) {
-    axis = 1;
-  } else {
-    axis = 0;
-  }
-
-  std::array<int, 2> initialPos;
-  std::array<int, 2> finishPos;
-  float initialDepth;
-  float finishDepth;
-
-  // find which pos is first
-  if (startPos[axis] <= endPos[axis]) {
-    for (int i = 0; i < 2; ++i) {
-      initialPos[i] = startPos[i];
-      finishPos[i] = endPos[i];
-      initialDepth = startDepth;
-      finishDepth = endDepth;
-    }
-  } else {
-    for (int i = 0; i < 2; ++i) {
-      initialPos[i] = endPos[i];
-      finishPos[i] = startPos[i];
-      initialDepth = endDepth;
-      finishDepth = startDepth;
-    }
-  }
-  int screenHeight = screen.height;
-  if ((std::max(initialPos[1], finishPos[1]) < -screenHeight / 2) || (std::min(initialPos[1], finishPos[1]) > screenHeight / 2)) return { points, depths };
-
-  // find point coordinates and depths
-  if (axis == 0) {
-    int start;
-    int end;
-
-    if (initialPos[1] < -screenHeight / 2 && gradient != 0) {
-      start = (-screenHeight/2-initialPos[1])/gradient+initialPos[0];
-    } else {
-      start = initialPos[0];
-    }
-
-    if (finishPos[1] > screenHeight / 2 && gradient != 0) {
-      end = (screenHeight/2-initialPos[1])/gradient+initialPos[0];
-    } else {
-      end = finishPos[0];
-    }
-
-    for (int x = start; x <= end; ++x) {
-      int y = std::round(gradient * (x - initialPos[0]) + initialPos[1]);
-      std::array<int, 2> point = {x, y};
-      points.push_back(point);
-
-      float depth;
-      if (finishPos[0] == initialPos[0]) {
-        depth = initialDepth;
-      } else {
-        depth = (float)(x - initialPos[0]) / (float)(finishPos[0] - initialPos[0]) * (finishDepth - initialDepth) + initialDepth; // linear interpolation
-      }
-      depths.push_back(depth);
-    }
-  } else {
-    int start = std::max(-screenHeight / 2, initialPos[1]);
-    int end = std::min(screenHeight / 2, finishPos[1]);
-
-    for (int y = start; y <= end; ++y) {
-      int x = std::round((y - initialPos[1]) / gradient + initialPos[0]);
-      std::array<int, 2> point = {x, y};
-      points.push_back(point);
-
-      float depth;
-      if (finishPos[1] == initialPos[1]) {
-        depth = initialDepth;
-      } else {
-        depth = (float)(y - initialPos[1]) / (float)(finishPos[1] - initialPos[1]) * (finishDepth - initialDepth) + initialDepth; // linear interpolation
-      }
-      depths.push_back(depth);
-    }
-  }
-
-  return  { points, depths };
-}
@@ -0,0 +1,130 @@
+#include "renderer.hpp"
+
+FrameScheduler::FrameScheduler(float framesPerSecond, bool dropLate) {
+  period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1 / framesPerSecond));
+  dropLateFrames = dropLate;
+  started = false;
+  missedFrames = 0;
+  droppedFrames = 0;
+}
+
+// sleeps until the next frame is due, or returns straight away when it is already late
+void FrameScheduler::waitForNextFrame() {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (!started) {
+    started = true;
+    deadline = now + period;
+    return;
+  }
+
+  if (now <= deadline) {
+    std::this_thread::sleep_until(deadline);
+    deadline += period;
+    return;
+  }
+
+  missedFrames++;
+  if (dropLateFrames) {
+    // skip every period that has already gone by
+    long long skipped = (now - deadline) / period;
+    droppedFrames += skipped;
+    deadline += period * (skipped + 1);
+  } else {
+    deadline += period;
+  }
+}
+
+int FrameScheduler::getMissedFrames() {
+  return missedFrames;
+}
+
+int FrameScheduler::getDroppedFrames() {
+  return droppedFrames;
+}
+
+FramePresenter::FramePresenter(PresentPolicy presentPolicy) : pending(0, 0), presenting(0, 0) {
+  policy = presentPolicy;
+  hasPending = false;
+  stopping = false;
+  stats = PresenterStats{};
+  collected = FrameProfile{};
+  encoder.profiler = &profiler;
+  thread = std::thread(&FramePresenter::presentLoop, this);
+}
+
+// writes the last frame submitted before stopping
+FramePresenter::~FramePresenter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  thread.join();
+}
+
+// hands a drawn screen over to be written, along with text to write below it. the screen gets back a
+// buffer of the same size with old contents, which the next render replaces ( or keeps its own with copyScreens ).
+void FramePresenter::submit(Screen& screen, const std::string& footer) {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (policy == PRESENT_EVERY_FRAME) {
+      changed.wait(lock, [&] { return !hasPending; });
+    } else if (hasPending) {
+      stats.replaced++;
+    }
+
+    if (copyScreens) {
+      pending.buffer = screen.buffer;
+    } else {
+      std::swap(pending.buffer, screen.buffer);
+    }
+    pending.width = screen.width;
+    pending.height = screen.height;
+    pendingFooter = footer;
+    hasPending = true;
+  }
+  screen.buffer.resize(screen.width * screen.height, Cell{ ' ', 0 });
+  changed.notify_all();
+}
+
+PresenterStats FramePresenter::getStats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return stats;
+}
+
+// the encode and write times and bytes written since the last call
+FrameProfile FramePresenter::takeProfile() {
+  std::lock_guard<std::mutex> lock(mutex);
+  FrameProfile profile = collected;
+  collected = FrameProfile{};
+  return profile;
+}
+
+void FramePresenter::presentLoop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    changed.wait(lock, [&] { return hasPending || stopping; });
+    if (!hasPending) return;
+
+    // take the waiting frame, leaving its old buffer to be swapped into the next submit
+    std::swap(presenting.buffer, pending.buffer);
+    presenting.width = pending.width;
+    presenting.height = pending.height;
+    std::swap(presentingFooter, pendingFooter);
+    hasPending = false;
+    lock.unlock();
+    changed.notify_all();
+
+    profiler.beginFrame();
+    encoder.encode(presenting);
+    encoder.output += presentingFooter;
+    encoder.write();
+    profiler.endFrame();
+
+    lock.lock();
+    stats.presented++;
+    collected.milliseconds[STAGE_ENCODE] += profiler.getLastFrame().milliseconds[STAGE_ENCODE];
+    collected.milliseconds[STAGE_WRITE] += profiler.getLastFrame().milliseconds[STAGE_WRITE];
+    collected.counts[COUNTER_BYTES_WRITTEN] += profiler.getLastFrame().counts[COUNTER_BYTES_WRITTEN];
+  }
+}
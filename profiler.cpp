@@ -0,0 +1,115 @@
+#include "renderer.hpp"
+#include <cstdio>
+
+static const char* stageNames[STAGE_COUNT] = { "transform", "shade", "bin", "raster", "fill", "encode", "write" };
+static const char* counterNames[COUNTER_COUNT] = { "faces", "faces_culled", "faces_cached", "lod_faces_saved", "triangles", "tile_triangles", "pixels_tested", "pixels_written", "hiz_triangles", "hiz_tiles", "bytes_written" };
+
+Profiler::Profiler() {
+  current = FrameProfile{};
+  last = FrameProfile{};
+  total = FrameProfile{};
+  totalFrames = 0;
+  inFrame = false;
+}
+
+// finishes the previous frame ( if it is still open ) and starts counting a new one
+void Profiler::beginFrame() {
+  endFrame();
+  current = FrameProfile{};
+  inFrame = true;
+}
+
+void Profiler::endFrame() {
+  if (!inFrame) return;
+  last = current;
+  for (int i = 0; i < STAGE_COUNT; ++i) total.milliseconds[i] += current.milliseconds[i];
+  for (int i = 0; i < COUNTER_COUNT; ++i) total.counts[i] += current.counts[i];
+  totalFrames++;
+  inFrame = false;
+}
+
+void Profiler::addTime(int stage, double milliseconds) {
+  current.milliseconds[stage] += milliseconds;
+}
+
+void Profiler::addCount(int counter, long long amount) {
+  current.counts[counter] += amount;
+}
+
+// adds another profile's times and counts to the current frame
+void Profiler::addProfile(const FrameProfile& profile) {
+  for (int i = 0; i < STAGE_COUNT; ++i) current.milliseconds[i] += profile.milliseconds[i];
+  for (int i = 0; i < COUNTER_COUNT; ++i) current.counts[i] += profile.counts[i];
+}
+
+const FrameProfile& Profiler::getLastFrame() {
+  return last;
+}
+
+// the average frame since resetAverage was last called
+FrameProfile Profiler::getAverage() {
+  FrameProfile average = total;
+  if (totalFrames == 0) return average;
+  for (int i = 0; i < STAGE_COUNT; ++i) average.milliseconds[i] /= totalFrames;
+  for (int i = 0; i < COUNTER_COUNT; ++i) average.counts[i] /= totalFrames;
+  return average;
+}
+
+int Profiler::getAverageFrameCount() {
+  return totalFrames;
+}
+
+void Profiler::resetAverage() {
+  total = FrameProfile{};
+  totalFrames = 0;
+}
+
+const char* Profiler::getStageName(int stage) {
+  return stageNames[stage];
+}
+
+const char* Profiler::getCounterName(int counter) {
+  return counterNames[counter];
+}
+
+// adds a single line describing a frame to output, for showing under the picture
+void Profiler::appendSummary(std::string& output, const FrameProfile& frame) {
+  char line[512];
+  int length = 0;
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    length += std::snprintf(line + length, sizeof(line) - length, "%s %.2f ", stageNames[i], frame.milliseconds[i]);
+  }
+  long long tested = frame.counts[COUNTER_PIXELS_TESTED];
+  long long written = frame.counts[COUNTER_PIXELS_WRITTEN];
+  std::snprintf(line + length, sizeof(line) - length, "ms | faces %lld culled %lld triangles %lld | pixels %lld/%lld | bytes %lld",
+                frame.counts[COUNTER_FACES], frame.counts[COUNTER_FACES_CULLED], frame.counts[COUNTER_TRIANGLES], written, tested, frame.counts[COUNTER_BYTES_WRITTEN]);
+  output += line;
+}
+
+void Profiler::writeCsvHeader(std::ostream& stream) {
+  for (int i = 0; i < STAGE_COUNT; ++i) stream << stageNames[i] << "_ms,";
+  for (int i = 0; i < COUNTER_COUNT; ++i) stream << counterNames[i] << (i + 1 < COUNTER_COUNT ? "," : "\n");
+}
+
+void Profiler::writeCsv(std::ostream& stream, const FrameProfile& frame) {
+  for (int i = 0; i < STAGE_COUNT; ++i) stream << frame.milliseconds[i] << ",";
+  for (int i = 0; i < COUNTER_COUNT; ++i) stream << frame.counts[i] << (i + 1 < COUNTER_COUNT ? "," : "\n");
+  stream.flush();
+}
+
+// one json object per line
+void Profiler::writeJson(std::ostream& stream, const FrameProfile& frame) {
+  stream << "{";
+  for (int i = 0; i < STAGE_COUNT; ++i) stream << "\"" << stageNames[i] << "_ms\":" << frame.milliseconds[i] << ",";
+  for (int i = 0; i < COUNTER_COUNT; ++i) stream << "\"" << counterNames[i] << "\":" << frame.counts[i] << (i + 1 < COUNTER_COUNT ? "," : "}\n");
+  stream.flush();
+}
+
+ScopedTimer::ScopedTimer(Profiler& timedProfiler, int timedStage) : profiler(timedProfiler) {
+  stage = timedStage;
+  start = std::chrono::steady_clock::now();
+}
+
+ScopedTimer::~ScopedTimer() {
+  profiler.addTime(stage, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
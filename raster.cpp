@@ -0,0 +1,118 @@
+#include "renderer.hpp"
+
+// floor of a / b for any signs of a and b
+static long long floorDiv(long long a, long long b) {
+  long long quotient = a / b;
+  if (a % b != 0 && ((a < 0) != (b < 0))) quotient--;
+  return quotient;
+}
+
+// ceiling of a / b for any signs of a and b
+static long long ceilDiv(long long a, long long b) {
+  return -floorDiv(-a, b);
+}
+
+// the largest ooz of any point of a triangle, at its nearest corner
+float getNearestOoz(const ScreenTriangle& triangle) {
+  return 1.0 / std::min(triangle.depths[0], std::min(triangle.depths[1], triangle.depths[2]));
+}
+
+// fills the part of a triangle inside clip using edge functions. each row's span is found directly
+// from the three edge equations, so the cost depends on the number of rows and pixels covered.
+// the depth of a point does not depend on clip, so filling a triangle in pieces gives the same result.
+// no point gets an ooz above getNearestOoz, which lets tiles skip triangles behind what they hold.
+// returns how many points were written
+int fillTriangle(Screen& screen, const ScreenTriangle& triangle, ScreenRect clip, RasterStats& stats) {
+  const std::array<std::array<int, 2>, 3>& points = triangle.points;
+  const std::array<float, 3>& depths = triangle.depths;
+
+  long long x0 = points[0][0], y0 = points[0][1];
+  long long x1 = points[1][0], y1 = points[1][1];
+  long long x2 = points[2][0], y2 = points[2][1];
+
+  long long area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0); // twice the signed area
+  if (area == 0) return 0;
+
+  // clip the bounding box ( y is up, with the origin at the centre )
+  long long minX = std::max(std::min(x0, std::min(x1, x2)), (long long)clip.minX);
+  long long maxX = std::min(std::max(x0, std::max(x1, x2)), (long long)clip.maxX);
+  long long minY = std::max(std::min(y0, std::min(y1, y2)), (long long)clip.minY);
+  long long maxY = std::min(std::max(y0, std::max(y1, y2)), (long long)clip.maxY);
+  if (minX > maxX || minY > maxY) return 0;
+#ifndef RENDERER_NO_PROFILE
+  stats.triangles++;
+#endif
+
+  // edge i runs from points[i] to points[i + 1], e(x, y) = a * x + b * y + c is >= 0 inside
+  long long a[3], b[3], c[3];
+  for (int i = 0; i < 3; ++i) {
+    std::array<int, 2> start = points[i];
+    std::array<int, 2> end = points[(i + 1) % 3];
+    a[i] = (long long)start[1] - end[1];
+    b[i] = (long long)end[0] - start[0];
+    c[i] = (long long)start[0] * end[1] - (long long)start[1] * end[0];
+    if (area < 0) {
+      a[i] = -a[i];
+      b[i] = -b[i];
+      c[i] = -c[i];
+    }
+  }
+
+  // ooz is linear in screen space, so it is interpolated as a plane
+  double ooz0 = 1 / depths[0];
+  double ooz1 = 1 / depths[1];
+  double ooz2 = 1 / depths[2];
+  float oozPerX = ((ooz1 - ooz0) * (y2 - y0) - (ooz2 - ooz0) * (y1 - y0)) / area;
+  float oozPerY = ((ooz2 - ooz0) * (x1 - x0) - (ooz1 - ooz0) * (x2 - x0)) / area;
+  double oozOrigin = ooz0 - (double)oozPerX * x0 - (double)oozPerY * y0;
+  float nearestOoz = getNearestOoz(triangle); // rounding can take the plane a little past the corners
+
+  // so is shade / z, which divided by ooz gives a perspective correct shade for smooth triangles
+  float shadePerX = 0, shadePerY = 0;
+  double shadeOrigin = 0;
+  int maxLevel = triangle.letterCount - 1;
+  if (triangle.letters) {
+    double shade0 = triangle.shades[0] * ooz0;
+    double shade1 = triangle.shades[1] * ooz1;
+    double shade2 = triangle.shades[2] * ooz2;
+    shadePerX = ((shade1 - shade0) * (y2 - y0) - (shade2 - shade0) * (y1 - y0)) / area;
+    shadePerY = ((shade2 - shade0) * (x1 - x0) - (shade1 - shade0) * (x2 - x0)) / area;
+    shadeOrigin = shade0 - (double)shadePerX * x0 - (double)shadePerY * y0;
+  }
+
+  int written = 0;
+  for (long long y = minY; y <= maxY; ++y) {
+    long long start = minX;
+    long long end = maxX;
+    for (int i = 0; i < 3 && start <= end; ++i) {
+      long long rowC = b[i] * y + c[i];
+      if (a[i] > 0) {
+        start = std::max(start, ceilDiv(-rowC, a[i]));
+      } else if (a[i] < 0) {
+        end = std::min(end, floorDiv(rowC, -a[i]));
+      } else if (rowC < 0) {
+        end = start - 1;
+      }
+    }
+
+    float rowOoz = oozOrigin + (double)oozPerY * y;
+    float rowShade = shadeOrigin + (double)shadePerY * y;
+    for (long long x = start; x <= end; ++x) {
+      std::array<int, 2> point = {(int)x, (int)y};
+      float ooz = std::min(rowOoz + oozPerX * x, nearestOoz);
+      char letter = triangle.letter;
+      if (triangle.letters) {
+        int level = (rowShade + shadePerX * x) / ooz * maxLevel + 0.5f;
+        letter = triangle.letters[std::max(0, std::min(level, maxLevel))];
+      }
+      written += screen.addPoint(point, ooz, letter, triangle.colour, triangle.averageOoz);
+    }
+#ifndef RENDERER_NO_PROFILE
+    if (end >= start) stats.pixelsTested += end - start + 1;
+#endif
+  }
+#ifndef RENDERER_NO_PROFILE
+  stats.pixelsWritten += written;
+#endif
+  return written;
+}
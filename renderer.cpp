@@ -0,0 +1,759 @@
+#include "renderer.hpp"
+
+Renderer::Renderer(int threadCount) : workers(threadCount), scaledScreen(0, 0) {
+  columns = 0;
+  rows = 0;
+  camera = Camera{ { 0, 0, 0 }, { 0, 0, 0 }, 100 };
+  cameraVersion = 0;
+  cameraSettled = false;
+  incremental = false;
+  lastBuffer = nullptr;
+  lastWidth = 0;
+  lastHeight = 0;
+  dirtyTiles = nullptr;
+  tilesToFill = nullptr;
+  tilesToFillCount = 0;
+  tileStarts = nullptr;
+  tileTriangles = nullptr;
+  triangleKeys = nullptr;
+  viewMatrix = getIdentityMatrix();
+  screenBounds = ScreenRect{ 0, -1, 0, -1 };
+  frustumPlanes = {};
+  cullStats = CullStats{};
+}
+
+void Renderer::setThreadCount(int threadCount) {
+  workers.setThreadCount(std::max(1, threadCount));
+}
+
+int Renderer::getThreadCount() {
+  return workers.getThreadCount();
+}
+
+// only fill the parts of the screen that changed since the last render. the screen must still hold
+// what was last rendered into it, anything else makes the next render fill every tile
+void Renderer::setIncremental(bool enabled) {
+  incremental = enabled;
+  lastBuffer = nullptr;
+}
+
+void Renderer::submit(const ScreenTriangle& triangle) {
+  triangles.push_back(triangle);
+}
+
+// the transform from world coordinates into camera coordinates ( camera at the origin, looking along y )
+Matrix Camera::getViewMatrix() const {
+  return multiplyMatrices(getRotationMatrix(-rotation[0], -rotation[1], -rotation[2]), getTranslationMatrix(-position[0], -position[1], -position[2]));
+}
+
+// rounds down, unlike dividing
+static int divideDown(int a, int b) {
+  return a / b - (a % b != 0 && a < 0);
+}
+
+// sets up the camera for a frame, moving the lights into camera space once and finding the planes
+// around what the screen can show. a scaled resolution draws into a smaller screen with a focal length
+// to match, covering every cell of the screen once stretched over it
+void Renderer::setCamera(const Camera& frameCamera, const std::vector<std::array<float,4>>& lightSources, const Screen& screen) {
+  profiler.beginFrame();
+  bool qualityChanged = nextQuality != quality;
+  quality = nextQuality;
+  Camera scaledCamera = frameCamera;
+  ScreenRect bounds = screen.getBounds();
+  int scale = quality.resolutionScale;
+  if (scale > 1) {
+    scaledCamera.focalLength = std::max(1, frameCamera.focalLength / scale);
+    int width = screen.width / scale, height = screen.height / scale;
+    while (-width / 2 > divideDown(bounds.minX, scale) || width - width / 2 - 1 < divideDown(bounds.maxX, scale)) width++;
+    while (height / 2 - height + 1 > divideDown(bounds.minY, scale) || height / 2 < divideDown(bounds.maxY, scale)) height++;
+    if (scaledScreen.width != width || scaledScreen.height != height) scaledScreen = Screen(width, height);
+    bounds = scaledScreen.getBounds();
+  }
+  cameraSettled = !qualityChanged && scaledCamera.position == camera.position && scaledCamera.rotation == camera.rotation &&
+                  scaledCamera.focalLength == camera.focalLength && scaledCamera.nearPlane == camera.nearPlane &&
+                  lightSources == worldLights && bounds.minX == screenBounds.minX && bounds.maxX == screenBounds.maxX &&
+                  bounds.minY == screenBounds.minY && bounds.maxY == screenBounds.maxY;
+  if (!cameraSettled) cameraVersion++;
+  camera = scaledCamera;
+  worldLights = lightSources;
+  viewMatrix = camera.getViewMatrix();
+  screenBounds = bounds;
+  cullStats = CullStats{};
+
+  // the side planes pass through the camera and the screen edges ( widened by a cell for rounding )
+  float focal = camera.focalLength;
+  float left = screenBounds.minX - 1, right = screenBounds.maxX + 1;
+  float bottom = screenBounds.minY - 1, top = screenBounds.maxY + 1;
+  frustumPlanes[0] = { 0, 1, 0, -camera.nearPlane };
+  frustumPlanes[1] = { focal, -left, 0, 0 };
+  frustumPlanes[2] = { -focal, right, 0, 0 };
+  frustumPlanes[3] = { 0, -bottom, focal, 0 };
+  frustumPlanes[4] = { 0, top, -focal, 0 };
+  for (int i = 1; i < 5; ++i) {
+    float length = std::sqrt(frustumPlanes[i][0] * frustumPlanes[i][0] + frustumPlanes[i][1] * frustumPlanes[i][1] + frustumPlanes[i][2] * frustumPlanes[i][2]);
+    for (int j = 0; j < 4; ++j) frustumPlanes[i][j] /= length;
+  }
+
+  // past maxLights, only the strongest are kept ( the earlier of two as strong ), still in their order
+  cameraLights.clear();
+  for (int i = 0; i < lightSources.size(); ++i) {
+    const std::array<float, 4>& lightSource = lightSources[i];
+    if (quality.maxLights >= 0) {
+      int stronger = 0;
+      for (int j = 0; j < lightSources.size(); ++j) stronger += lightSources[j][3] > lightSource[3] || (lightSources[j][3] == lightSource[3] && j < i);
+      if (stronger >= quality.maxLights) continue;
+    }
+    std::array<float, 3> position = transformVertex(viewMatrix, { lightSource[0], lightSource[1], lightSource[2] });
+    cameraLights.push_back({ position[0], position[1], position[2], lightSource[3] });
+  }
+}
+
+// the rectangle around the corners of triangles[first] to triangles[end - 1], empty if there are none
+static ScreenRect getTrianglesRect(const std::vector<ScreenTriangle>& triangles, int first, int end) {
+  ScreenRect rect = { std::numeric_limits<int>::max(), std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), std::numeric_limits<int>::min() };
+  for (int i = first; i < end; ++i) {
+    for (const std::array<int, 2>& point : triangles[i].points) {
+      rect.minX = std::min(rect.minX, point[0]);
+      rect.maxX = std::max(rect.maxX, point[0]);
+      rect.minY = std::min(rect.minY, point[1]);
+      rect.maxY = std::max(rect.maxY, point[1]);
+    }
+  }
+  return rect;
+}
+
+// whether a triangle's corners are in a line on the screen, so filling it would not cover a point
+static bool isFlat(const ScreenTriangle& triangle) {
+  const std::array<std::array<int, 2>, 3>& points = triangle.points;
+  return ((long long)points[1][0] - points[0][0]) * ((long long)points[2][1] - points[0][1]) ==
+         ((long long)points[2][0] - points[0][0]) * ((long long)points[1][1] - points[0][1]);
+}
+
+// adds part's counts to total, or takes them away with a sign of -1
+static void addCullStats(CullStats& total, const CullStats& part, int sign) {
+  total.faces += sign * part.faces;
+  total.culledByModel += sign * part.culledByModel;
+  total.culledByClipping += sign * part.culledByClipping;
+  total.culledBackFacing += sign * part.culledBackFacing;
+  total.culledOffScreen += sign * part.culledOffScreen;
+  total.drawn += sign * part.drawn;
+}
+
+// submits the triangles of a mesh. with a cache, the triangles from the last time are submitted again
+// if the camera has not changed since ( the caller clears the cache when the transform or mesh changes ),
+// and new ones are kept once the camera has settled and the cache isn't marked as moving. meshes with
+// simpler versions are drawn with the one that suits their size on the screen
+void Renderer::drawMesh(const Mesh& mesh, const Matrix& transform, DrawCache* cache) {
+  if (reuseCache(cache)) return;
+  int firstTriangle = triangles.size();
+  CullStats before = cullStats;
+  Matrix modelView = multiplyMatrices(viewMatrix, transform);
+  std::array<float, 3> centre = transformVertex(modelView, mesh.boundsCentre);
+  if (cache) cache->lodLevels.resize(1, LOD_UNKNOWN);
+  drawCopy(mesh, modelView, nullptr, centre, getScale(transform), -1, cache ? &cache->lodLevels[0] : nullptr);
+  finishDraw(firstTriangle, before, cache);
+}
+
+// culls one copy of a mesh by its bounding sphere ( its centre in camera space, its radius grown by
+// scale ) or submits the version that suits the same sphere's size on the screen. an instance's own
+// transform goes on top of modelView, and is only applied once the copy is known to be in view
+void Renderer::drawCopy(const Mesh& mesh, const Matrix& modelView, const Matrix* instance, const std::array<float, 3>& centre, float scale, int material, unsigned char* level) {
+  float radius = mesh.boundsRadius * scale;
+  if (isOutsideView(centre, radius)) {
+    countCulledMesh(mesh);
+    return;
+  }
+  const Mesh& lod = selectLod(mesh, radius, centre[1], level);
+  projectMesh(lod, instance ? multiplyMatrices(modelView, *instance) : modelView, material);
+}
+
+// submits a copy of mesh for every instance, placed by its own transform and then by transform.
+// the centres of every instance are moved into camera space in one batch, and instances outside the
+// view are dropped before any of their vertices are touched. the mesh's normals and bounds are shared
+// by every copy, so instance transforms should only rotate, move and scale evenly
+void Renderer::drawInstances(const Mesh& mesh, const Matrix& transform, const std::vector<Instance>& instances, DrawCache* cache) {
+  if (reuseCache(cache)) return;
+  int firstTriangle = triangles.size();
+  CullStats before = cullStats;
+  Matrix modelView = multiplyMatrices(viewMatrix, transform);
+  int count = instances.size();
+  FrameArena::Mark mark = frameArena.getMark();
+  float* instanceXs = frameArena.allocate<float>(count);
+  float* instanceYs = frameArena.allocate<float>(count);
+  float* instanceZs = frameArena.allocate<float>(count);
+  {
+    PROFILE_SCOPE(profiler, STAGE_TRANSFORM);
+    int* instanceScreenXs = frameArena.allocate<int>(count);
+    int* instanceScreenYs = frameArena.allocate<int>(count);
+    for (int i = 0; i < count; ++i) {
+      std::array<float, 3> centre = transformVertex(instances[i].transform, mesh.boundsCentre);
+      instanceXs[i] = centre[0];
+      instanceYs[i] = centre[1];
+      instanceZs[i] = centre[2];
+    }
+    VertexBatch batch = { instanceXs, instanceYs, instanceZs, instanceXs, instanceYs, instanceZs, instanceScreenXs, instanceScreenYs, count };
+    transformVertices(modelView, camera.focalLength, batch);
+  }
+
+  if (cache) cache->lodLevels.resize(count, LOD_UNKNOWN);
+  float scale = getScale(transform); // instances are scaled by whatever holds them too
+  for (int i = 0; i < count; ++i) {
+    drawCopy(mesh, modelView, &instances[i].transform, { instanceXs[i], instanceYs[i], instanceZs[i] }, scale * getScale(instances[i].transform),
+             instances[i].material, cache ? &cache->lodLevels[i] : nullptr);
+  }
+  frameArena.rewind(mark);
+  finishDraw(firstTriangle, before, cache);
+}
+
+// submits the cache's triangles again if they are still right for the camera
+bool Renderer::reuseCache(DrawCache* cache) {
+  closeDraws();
+  if (!cache || cache->moving || cache->cameraVersion != cameraVersion) return false;
+  int firstTriangle = triangles.size();
+  triangles.insert(triangles.end(), cache->triangles.begin(), cache->triangles.end());
+  recordDraw(firstTriangle, cache, true, cache->bounds);
+  addCullStats(cullStats, cache->cullStats, 1);
+  PROFILE_COUNT(profiler, COUNTER_FACES, cache->cullStats.faces);
+  PROFILE_COUNT(profiler, COUNTER_FACES_CULLED, cache->cullStats.faces - cache->cullStats.drawn);
+  PROFILE_COUNT(profiler, COUNTER_FACES_CACHED, cache->cullStats.faces);
+  return true;
+}
+
+// records the triangles submitted since firstTriangle as one draw, keeping them in the cache once the camera has settled
+void Renderer::finishDraw(int firstTriangle, const CullStats& before, DrawCache* cache) {
+  ScreenRect bounds = getTrianglesRect(triangles, firstTriangle, triangles.size());
+  bool filled = cache && cameraSettled && !cache->moving;
+  if (filled) {
+    cache->triangles.assign(triangles.begin() + firstTriangle, triangles.end());
+    cache->cullStats = cullStats;
+    addCullStats(cache->cullStats, before, -1);
+    cache->bounds = bounds;
+    cache->cameraVersion = cameraVersion;
+  }
+  recordDraw(firstTriangle, filled ? cache : nullptr, false, bounds);
+}
+
+// whether a sphere ( in camera space ) is entirely outside the view
+bool Renderer::isOutsideView(const std::array<float, 3>& centre, float radius) {
+  for (const std::array<float, 4>& plane : frustumPlanes) {
+    if (plane[0] * centre[0] + plane[1] * centre[1] + plane[2] * centre[2] + plane[3] < -radius) return true;
+  }
+  return false;
+}
+
+// the simplest version of a mesh that still has about as many faces as the cells its bounding sphere
+// ( radius across, depth in front of the camera ) covers. level holds the version picked last time,
+// which is kept until the size is a good way past where the choice changes, so a mesh near the edge
+// doesn't keep swapping between two
+const Mesh& Renderer::selectLod(const Mesh& mesh, float radius, float depth, unsigned char* level) {
+  int levels = mesh.lods.size();
+  if (levels == 0) return mesh;
+  auto getFaceCount = [&](int lod) { return lod == 0 ? mesh.getFaceCount() : mesh.lods[lod - 1].getFaceCount(); };
+  // the first level with at most budget faces, or the simplest
+  auto pick = [&](float budget) {
+    int lod = 0;
+    while (lod < levels && getFaceCount(lod) > budget) lod++;
+    return lod;
+  };
+
+  int chosen = 0;
+  if (depth > radius) {
+    float projected = radius * camera.focalLength / depth;
+    float budget = LOD_FACES_PER_CELL * quality.lodBias * PI * projected * projected;
+    chosen = pick(budget);
+    if (level && *level <= levels) {
+      if (chosen > *level) chosen = std::max<int>(*level, pick(budget * LOD_HYSTERESIS));
+      else if (chosen < *level) chosen = std::min<int>(*level, pick(budget / LOD_HYSTERESIS));
+    }
+  }
+  if (level) *level = chosen;
+  PROFILE_COUNT(profiler, COUNTER_LOD_FACES_SAVED, mesh.getFaceCount() - getFaceCount(chosen));
+  return chosen == 0 ? mesh : mesh.lods[chosen - 1];
+}
+
+// the planes around what the screen can show, in the world rather than camera space, for culling
+// before anything is submitted
+std::array<std::array<float, 4>, 5> Renderer::getWorldFrustum() {
+  std::array<std::array<float, 4>, 5> planes;
+  for (int p = 0; p < 5; ++p) {
+    const std::array<float, 4>& plane = frustumPlanes[p];
+    for (int i = 0; i < 3; ++i) planes[p][i] = plane[0] * viewMatrix[0][i] + plane[1] * viewMatrix[1][i] + plane[2] * viewMatrix[2][i];
+    planes[p][3] = plane[0] * viewMatrix[0][3] + plane[1] * viewMatrix[1][3] + plane[2] * viewMatrix[2][3] + plane[3];
+  }
+  return planes;
+}
+
+void Renderer::countCulledMesh(const Mesh& mesh) {
+  cullStats.faces += mesh.getFaceCount();
+  cullStats.culledByModel += mesh.getFaceCount();
+  PROFILE_COUNT(profiler, COUNTER_FACES, mesh.getFaceCount());
+  PROFILE_COUNT(profiler, COUNTER_FACES_CULLED, mesh.getFaceCount());
+}
+
+void Renderer::recordDraw(int firstTriangle, const DrawCache* cache, bool reused, ScreenRect bounds) {
+  draws.push_back(DrawRecord{ firstTriangle, (int)triangles.size(), bounds, cache, reused, false });
+}
+
+// records triangles submitted on their own since the last draw as a draw of their own
+void Renderer::closeDraws() {
+  int recorded = draws.empty() ? 0 : draws.back().endTriangle;
+  if (recorded < triangles.size()) recordDraw(recorded, nullptr, false, getTrianglesRect(triangles, recorded, triangles.size()));
+}
+
+// moves every vertex of the mesh into camera space and onto the screen once, with a single
+// combined matrix, then lights and submits each face. material overrides the mesh's materials unless it is -1
+void Renderer::projectMesh(const Mesh& mesh, const Matrix& modelView, int material) {
+  cullStats.faces += mesh.getFaceCount();
+  PROFILE_COUNT(profiler, COUNTER_FACES, mesh.getFaceCount());
+
+  // camera space and screen positions of the vertices, only needed until the mesh is submitted
+  FrameArena::Mark mark = frameArena.getMark();
+  int vertexCount = mesh.getVertexCount();
+  float* cameraXs = frameArena.allocate<float>(vertexCount);
+  float* cameraYs = frameArena.allocate<float>(vertexCount);
+  float* cameraZs = frameArena.allocate<float>(vertexCount);
+  int* screenXs = frameArena.allocate<int>(vertexCount);
+  int* screenYs = frameArena.allocate<int>(vertexCount);
+  unsigned char* outcodes = frameArena.allocate<unsigned char>(vertexCount);
+  {
+    PROFILE_SCOPE(profiler, STAGE_TRANSFORM);
+    VertexBatch batch = { mesh.xs.data(), mesh.ys.data(), mesh.zs.data(), cameraXs, cameraYs, cameraZs, screenXs, screenYs, vertexCount };
+    transformVertices(modelView, camera.focalLength, batch);
+
+    for (int i = 0; i < vertexCount; ++i) {
+      outcodes[i] = getOutcode({ cameraXs[i], cameraYs[i], cameraZs[i] }, camera.nearPlane, camera.focalLength);
+    }
+  }
+
+  PROFILE_SCOPE(profiler, STAGE_SHADE);
+  // the faces that survive culling, with their normals and a corner in camera space, lit together
+  // once they are all known
+  int faceCount = mesh.getFaceCount();
+  int* visibleFaces = frameArena.allocate<int>(faceCount);
+  float* faceNormalXs = frameArena.allocate<float>(faceCount);
+  float* faceNormalYs = frameArena.allocate<float>(faceCount);
+  float* faceNormalZs = frameArena.allocate<float>(faceCount);
+  float* facePointXs = frameArena.allocate<float>(faceCount);
+  float* facePointYs = frameArena.allocate<float>(faceCount);
+  float* facePointZs = frameArena.allocate<float>(faceCount);
+  float* faceShades = frameArena.allocate<float>(faceCount);
+
+  int visibleCount = 0;
+  for (int face = 0; face < faceCount; ++face) {
+    std::array<int, 3> corners = { mesh.indices[face * 3], mesh.indices[face * 3 + 1], mesh.indices[face * 3 + 2] };
+
+    // entirely behind the near plane or outside the guard band
+    if (outcodes[corners[0]] & outcodes[corners[1]] & outcodes[corners[2]]) {
+      cullStats.culledByClipping++;
+      continue;
+    }
+
+    // facing away from the camera ( at the origin )
+    std::array<float, 3> normal = rotateDirection(modelView, { mesh.faceNormalXs[face], mesh.faceNormalYs[face], mesh.faceNormalZs[face] });
+    if (mesh.closed && normal[0] * cameraXs[corners[0]] + normal[1] * cameraYs[corners[0]] + normal[2] * cameraZs[corners[0]] >= 0) {
+      cullStats.culledBackFacing++;
+      continue;
+    }
+
+    // projected entirely off the screen
+    if (!(outcodes[corners[0]] | outcodes[corners[1]] | outcodes[corners[2]])) {
+      if (std::max(screenXs[corners[0]], std::max(screenXs[corners[1]], screenXs[corners[2]])) < screenBounds.minX ||
+          std::min(screenXs[corners[0]], std::min(screenXs[corners[1]], screenXs[corners[2]])) > screenBounds.maxX ||
+          std::max(screenYs[corners[0]], std::max(screenYs[corners[1]], screenYs[corners[2]])) < screenBounds.minY ||
+          std::min(screenYs[corners[0]], std::min(screenYs[corners[1]], screenYs[corners[2]])) > screenBounds.maxY) {
+        cullStats.culledOffScreen++;
+        continue;
+      }
+    }
+
+    visibleFaces[visibleCount] = face;
+    faceNormalXs[visibleCount] = normal[0];
+    faceNormalYs[visibleCount] = normal[1];
+    faceNormalZs[visibleCount] = normal[2];
+    facePointXs[visibleCount] = cameraXs[corners[1]];
+    facePointYs[visibleCount] = cameraYs[corners[1]];
+    facePointZs[visibleCount] = cameraZs[corners[1]];
+    visibleCount++;
+  }
+
+  // light every visible face at once, and every vertex for smooth meshes ( unless the quality says otherwise )
+  if (quality.lighting == LIGHTING_NONE) std::fill(faceShades, faceShades + visibleCount, 0);
+  else lightSurfaces(cameraLights, LightBatch{ faceNormalXs, faceNormalYs, faceNormalZs, facePointXs, facePointYs, facePointZs, faceShades, visibleCount });
+  bool smoothAllowed = quality.lighting == LIGHTING_SMOOTH;
+  bool smooth = smoothAllowed && mesh.smooth;
+  for (int i = 0; i < visibleCount && smoothAllowed && !smooth; ++i) smooth = getMaterial(material >= 0 ? material : mesh.faceMaterials[visibleFaces[i]]).smooth;
+  // vertex normals in camera space and the light at each vertex
+  float* vertexShades = nullptr;
+  if (smooth) {
+    float* vertexNormalXs = frameArena.allocate<float>(vertexCount);
+    float* vertexNormalYs = frameArena.allocate<float>(vertexCount);
+    float* vertexNormalZs = frameArena.allocate<float>(vertexCount);
+    vertexShades = frameArena.allocate<float>(vertexCount);
+    for (int i = 0; i < vertexCount; ++i) {
+      std::array<float, 3> normal = rotateDirection(modelView, { mesh.vertexNormalXs[i], mesh.vertexNormalYs[i], mesh.vertexNormalZs[i] });
+      vertexNormalXs[i] = normal[0];
+      vertexNormalYs[i] = normal[1];
+      vertexNormalZs[i] = normal[2];
+    }
+    lightSurfaces(cameraLights, LightBatch{ vertexNormalXs, vertexNormalYs, vertexNormalZs, cameraXs, cameraYs, cameraZs, vertexShades, vertexCount });
+  }
+
+  ScreenTriangle projected;
+  for (int i = 0; i < visibleCount; ++i) {
+    int face = visibleFaces[i];
+    std::array<int, 3> corners = { mesh.indices[face * 3], mesh.indices[face * 3 + 1], mesh.indices[face * 3 + 2] };
+    std::array<std::array<float, 3>, 3> vertices;
+    for (int j = 0; j < 3; ++j) {
+      vertices[j] = { cameraXs[corners[j]], cameraYs[corners[j]], cameraZs[corners[j]] };
+      projected.points[j] = { screenXs[corners[j]], screenYs[corners[j]] };
+      projected.depths[j] = vertices[j][1];
+    }
+
+    const Material& faceMaterial = getMaterial(material >= 0 ? material : mesh.faceMaterials[face]);
+    int letterCount = faceMaterial.letters.size();
+    int level = std::round(faceShades[i] * (letterCount - 1));
+    projected.letter = faceMaterial.letters[std::max(0, std::min(level, letterCount - 1))];
+    projected.colour = faceMaterial.colour;
+    if (smoothAllowed && (mesh.smooth || faceMaterial.smooth)) {
+      projected.letters = faceMaterial.letters.data();
+      projected.letterCount = letterCount;
+      projected.shades = { vertexShades[corners[0]], vertexShades[corners[1]], vertexShades[corners[2]] };
+    } else {
+      projected.letters = nullptr;
+    }
+    cullStats.drawn++;
+
+    int outsideAny = outcodes[corners[0]] | outcodes[corners[1]] | outcodes[corners[2]];
+    if (outsideAny) {
+      submitClipped(projected, vertices, outsideAny);
+    } else {
+      projected.averageOoz = 3 / (projected.depths[0] + projected.depths[1] + projected.depths[2]);
+      submit(projected);
+    }
+  }
+  frameArena.rewind(mark);
+  PROFILE_COUNT(profiler, COUNTER_FACES_CULLED, faceCount - visibleCount);
+}
+
+// the shade at a point on a triangle, blended from the shades at its corners
+static float getShadeAt(const std::array<std::array<float, 3>, 3>& vertices, const std::array<float, 3>& shades, const std::array<float, 3>& point) {
+  std::array<float, 3> ab, ac, ap;
+  for (int i = 0; i < 3; ++i) {
+    ab[i] = vertices[1][i] - vertices[0][i];
+    ac[i] = vertices[2][i] - vertices[0][i];
+    ap[i] = point[i] - vertices[0][i];
+  }
+  float abab = 0, abac = 0, acac = 0, apab = 0, apac = 0;
+  for (int i = 0; i < 3; ++i) {
+    abab += ab[i] * ab[i];
+    abac += ab[i] * ac[i];
+    acac += ac[i] * ac[i];
+    apab += ap[i] * ab[i];
+    apac += ap[i] * ac[i];
+  }
+  float denominator = abab * acac - abac * abac;
+  if (denominator == 0) return shades[0];
+  float v = (acac * apab - abac * apac) / denominator;
+  float w = (abab * apac - abac * apab) / denominator;
+  return (1 - v - w) * shades[0] + v * shades[1] + w * shades[2];
+}
+
+// clips a triangle in camera space against the planes it crosses and submits the pieces
+void Renderer::submitClipped(ScreenTriangle& projected, std::array<std::array<float, 3>, 3> vertices, int planes) {
+  ClippedPolygon polygon;
+  for (int i = 0; i < 3; ++i) polygon[i] = vertices[i];
+  int count = clipPolygon(polygon, 3, planes, camera.nearPlane, camera.focalLength);
+  std::array<float, 3> cornerShades = projected.shades;
+
+  for (int i = 1; i + 1 < count; ++i) {
+    std::array<int, 3> corners = { 0, i, i + 1 };
+    for (int j = 0; j < 3; ++j) {
+      projected.points[j] = get2dPos(polygon[corners[j]], camera.focalLength);
+      projected.depths[j] = polygon[corners[j]][1];
+      if (projected.letters) projected.shades[j] = getShadeAt(vertices, cornerShades, polygon[corners[j]]);
+    }
+    projected.averageOoz = 3 / (projected.depths[0] + projected.depths[1] + projected.depths[2]);
+    submit(projected);
+  }
+}
+
+CullStats Renderer::getCullStats() {
+  return cullStats;
+}
+
+ArenaStats Renderer::getArenaStats() {
+  ArenaStats stats = { frameArena.getHighWater(), 0, frameArena.getCapacity() };
+  for (const FrameArena& arena : workerArenas) {
+    stats.workerBytes = std::max(stats.workerBytes, arena.getHighWater());
+    stats.capacityBytes += arena.getCapacity();
+  }
+  return stats;
+}
+
+// changes what the renderer trades for time, from the next setCamera on. drawing anything at a new
+// setting works it out again rather than reusing what was cached
+void Renderer::setQuality(const QualitySettings& settings) {
+  nextQuality = settings;
+  nextQuality.resolutionScale = std::max(1, settings.resolutionScale);
+}
+
+const QualitySettings& Renderer::getQuality() {
+  return quality;
+}
+
+bool QualitySettings::operator==(const QualitySettings& other) const {
+  return resolutionScale == other.resolutionScale && lodBias == other.lodBias && lighting == other.lighting && maxLights == other.maxLights;
+}
+
+// starts measuring the high water marks again, for a new workload
+void Renderer::resetArenaStats() {
+  frameArena.resetHighWater();
+  for (FrameArena& arena : workerArenas) arena.resetHighWater();
+}
+
+// a triangle of the tile being filled, with the key it is sorted by
+struct TileEntry {
+  float key;
+  int triangle;
+};
+
+// replaces the whole screen with the triangles submitted since the last render, filling a smaller
+// screen and stretching it over this one when the resolution is scaled
+void Renderer::render(Screen& screen) {
+  if (quality.resolutionScale <= 1) {
+    fillScreen(screen);
+    return;
+  }
+  fillScreen(scaledScreen);
+  PROFILE_SCOPE(profiler, STAGE_RASTER);
+  screen.stretch(scaledScreen, quality.resolutionScale);
+}
+
+// each tile (and its part of the buffer and zbuffer) belongs to one worker, so no locking is needed.
+// when rendering incrementally, tiles nothing changed in keep what the last render left in them
+void Renderer::fillScreen(Screen& screen) {
+  columns = (screen.width + TILE_WIDTH - 1) / TILE_WIDTH;
+  rows = (screen.height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+  screenBounds = screen.getBounds();
+  closeDraws();
+
+  PROFILE_COUNT(profiler, COUNTER_TRIANGLES, triangles.size());
+  bool everyTile = !incremental || screen.buffer.data() != lastBuffer || screen.width != lastWidth || screen.height != lastHeight;
+  {
+    PROFILE_SCOPE(profiler, STAGE_BIN);
+    tilesToFill = frameArena.allocate<int>(columns * rows);
+    if (everyTile) {
+      tilesToFillCount = columns * rows;
+      for (int tile = 0; tile < columns * rows; ++tile) tilesToFill[tile] = tile;
+    } else {
+      markDirtyTiles(screen);
+    }
+    binTriangles(screen, everyTile);
+    triangleKeys = frameArena.allocate<float>(triangles.size());
+    for (int i = 0; i < triangles.size(); ++i) triangleKeys[i] = getNearestOoz(triangles[i]);
+  }
+
+  // each worker counts into its own stats, merged once every tile is done
+  workerStats.assign(workers.getThreadCount(), RasterStats{});
+  if (workerArenas.size() < workers.getThreadCount()) workerArenas.resize(workers.getThreadCount());
+  auto fillTile = [&](int task, int worker) {
+#ifndef RENDERER_NO_PROFILE
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+    int tile = tilesToFill[task];
+    int firstColumn = (tile % columns) * TILE_WIDTH;
+    int lastColumn = std::min(firstColumn + TILE_WIDTH, screen.width);
+    int firstRow = (tile / columns) * TILE_HEIGHT;
+    int lastRow = std::min(firstRow + TILE_HEIGHT, screen.height);
+    for (int row = firstRow; row < lastRow; ++row) {
+      std::fill(screen.buffer.begin() + row * screen.width + firstColumn, screen.buffer.begin() + row * screen.width + lastColumn, Cell{ ' ', 0 });
+      std::fill(screen.zBuffer.begin() + row * screen.width + firstColumn, screen.zBuffer.begin() + row * screen.width + lastColumn, 0);
+      std::fill(screen.tieBuffer.begin() + row * screen.width + firstColumn, screen.tieBuffer.begin() + row * screen.width + lastColumn, 0);
+    }
+
+    // nearest first, so once a triangle is entirely behind every cell of the tile so is the rest.
+    // sorted as key and index pairs in the worker's arena, so comparing doesn't jump around triangleKeys.
+    // the farthest cell is only looked for again after a fair part of the tile has been written
+    FrameArena& arena = workerArenas[worker];
+    int count = tileStarts[tile + 1] - tileStarts[tile];
+    TileEntry* order = arena.allocate<TileEntry>(count);
+    for (int i = 0; i < count; ++i) {
+      int triangle = tileTriangles[tileStarts[tile] + i];
+      order[i] = TileEntry{ triangleKeys[triangle], triangle };
+    }
+    std::sort(order, order + count, [](const TileEntry& a, const TileEntry& b) {
+      return a.key > b.key || (a.key == b.key && a.triangle < b.triangle);
+    });
+    ScreenRect bounds = getTileBounds(screen, tile);
+    float farthestOoz = 0;
+    int writtenSinceCheck = 0;
+    for (int i = 0; i < count; ++i) {
+      if (order[i].key < farthestOoz) {
+#ifndef RENDERER_NO_PROFILE
+        workerStats[worker].hizTriangles += count - i;
+        workerStats[worker].hizTiles++;
+#endif
+        break;
+      }
+      writtenSinceCheck += fillTriangle(screen, triangles[order[i].triangle], bounds, workerStats[worker]);
+      if (writtenSinceCheck >= TILE_WIDTH * TILE_HEIGHT / 4 && i + 1 < count) {
+        farthestOoz = std::numeric_limits<float>::max();
+        for (int row = firstRow; row < lastRow; ++row) {
+          for (int column = firstColumn; column < lastColumn; ++column) farthestOoz = std::min(farthestOoz, screen.zBuffer[row * screen.width + column]);
+        }
+        writtenSinceCheck = 0;
+      }
+    }
+    arena.reset();
+#ifndef RENDERER_NO_PROFILE
+    workerStats[worker].fillMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+#endif
+  };
+  {
+    PROFILE_SCOPE(profiler, STAGE_RASTER);
+    workers.run(tilesToFillCount, fillTile);
+  }
+
+  for (const RasterStats& stats : workerStats) {
+    PROFILE_COUNT(profiler, COUNTER_TILE_TRIANGLES, stats.triangles);
+    PROFILE_COUNT(profiler, COUNTER_PIXELS_TESTED, stats.pixelsTested);
+    PROFILE_COUNT(profiler, COUNTER_PIXELS_WRITTEN, stats.pixelsWritten);
+    PROFILE_COUNT(profiler, COUNTER_HIZ_TRIANGLES, stats.hizTriangles);
+    PROFILE_COUNT(profiler, COUNTER_HIZ_TILES, stats.hizTiles);
+#ifndef RENDERER_NO_PROFILE
+    profiler.addTime(STAGE_FILL, stats.fillMilliseconds);
+#endif
+  }
+
+  // keep room for the next frame to grow a little without reallocating mid-submit
+  if (triangles.size() * 4 > triangles.capacity() * 3) triangles.reserve(triangles.size() * 2);
+  triangles.clear();
+  frameArena.reset();
+  dirtyTiles = nullptr;
+  tilesToFill = nullptr;
+  tileStarts = nullptr;
+  tileTriangles = nullptr;
+  triangleKeys = nullptr;
+
+  // remember what this frame drew, to compare the next one against
+  std::swap(draws, lastDraws);
+  draws.clear();
+  if (incremental) {
+    lastCaches.clear();
+    for (const DrawRecord& draw : lastDraws) {
+      if (draw.cache) lastCaches.push_back(draw.cache);
+    }
+    std::sort(lastCaches.begin(), lastCaches.end());
+    lastBuffer = screen.buffer.data();
+    lastWidth = screen.width;
+    lastHeight = screen.height;
+  }
+}
+
+// a draw is unchanged when it reused a cache whose triangles were also drawn last frame. every other
+// draw, and every draw of the last frame whose cache was not reused, marks the tiles it covers
+void Renderer::markDirtyTiles(Screen& screen) {
+  dirtyTiles = frameArena.allocate<unsigned char>(columns * rows);
+  std::fill(dirtyTiles, dirtyTiles + columns * rows, 0);
+  // sorted, of this frame's draws
+  int reusedCount = 0;
+  for (const DrawRecord& draw : draws) reusedCount += draw.reused;
+  const DrawCache** reusedCaches = frameArena.allocate<const DrawCache*>(reusedCount);
+  reusedCount = 0;
+  for (const DrawRecord& draw : draws) {
+    if (draw.reused) reusedCaches[reusedCount++] = draw.cache;
+  }
+  std::sort(reusedCaches, reusedCaches + reusedCount);
+
+  for (const DrawRecord& draw : draws) {
+    if (!draw.reused || !std::binary_search(lastCaches.begin(), lastCaches.end(), draw.cache)) markDirtyRect(screen, draw.bounds);
+  }
+  for (const DrawRecord& draw : lastDraws) {
+    if (!draw.cache || !std::binary_search(reusedCaches, reusedCaches + reusedCount, draw.cache)) markDirtyRect(screen, draw.bounds);
+  }
+
+  tilesToFillCount = 0;
+  for (int tile = 0; tile < columns * rows; ++tile) {
+    if (dirtyTiles[tile]) tilesToFill[tilesToFillCount++] = tile;
+  }
+}
+
+void Renderer::markDirtyRect(Screen& screen, ScreenRect rect) {
+  std::array<int, 4> range;
+  if (!getTileRange(screen, rect, range)) return;
+  for (int row = range[2]; row <= range[3]; ++row) {
+    for (int column = range[0]; column <= range[1]; ++column) {
+      dirtyTiles[row * columns + column] = 1;
+    }
+  }
+}
+
+// the first and last tile column and row a rectangle overlaps, false if it is off screen
+bool Renderer::getTileRange(Screen& screen, ScreenRect rect, std::array<int, 4>& range) {
+  int minX = std::max(rect.minX, screenBounds.minX);
+  int maxX = std::min(rect.maxX, screenBounds.maxX);
+  int minY = std::max(rect.minY, screenBounds.minY);
+  int maxY = std::min(rect.maxY, screenBounds.maxY);
+  if (minX > maxX || minY > maxY) return false;
+
+  // convert to buffer columns and rows ( y is flipped )
+  range[0] = (minX + screen.width / 2) / TILE_WIDTH;
+  range[1] = (maxX + screen.width / 2) / TILE_WIDTH;
+  range[2] = (screen.height / 2 - maxY) / TILE_HEIGHT;
+  range[3] = (screen.height / 2 - minY) / TILE_HEIGHT;
+  return true;
+}
+
+// adds every triangle to the tiles its bounding box overlaps, keeping submission order within each tile.
+// triangles too thin to cover a point ( most of a dense mesh far away ) are left out.
+// counts the triangles of each tile first, so every tile's indices can go into one flat array.
+// unless everyTile is set, only dirty tiles are filled and draws that miss them are skipped
+void Renderer::binTriangles(Screen& screen, bool everyTile) {
+  tileStarts = frameArena.allocate<int>(columns * rows + 1);
+  std::fill(tileStarts, tileStarts + columns * rows + 1, 0);
+  std::array<int, 4> range;
+  for (DrawRecord& draw : draws) {
+    draw.binned = everyTile;
+    if (!everyTile && getTileRange(screen, draw.bounds, range)) {
+      for (int row = range[2]; row <= range[3] && !draw.binned; ++row) {
+        for (int column = range[0]; column <= range[1] && !draw.binned; ++column) {
+          draw.binned = dirtyTiles[row * columns + column];
+        }
+      }
+    }
+    if (!draw.binned) continue;
+
+    for (int i = draw.firstTriangle; i < draw.endTriangle; ++i) {
+      if (isFlat(triangles[i]) || !getTileRange(screen, getTrianglesRect(triangles, i, i + 1), range)) continue;
+      for (int row = range[2]; row <= range[3]; ++row) {
+        for (int column = range[0]; column <= range[1]; ++column) {
+          if (everyTile || dirtyTiles[row * columns + column]) ++tileStarts[row * columns + column];
+        }
+      }
+    }
+  }
+  for (int tile = 1; tile <= columns * rows; ++tile) tileStarts[tile] += tileStarts[tile - 1];
+
+  tileTriangles = frameArena.allocate<int>(tileStarts[columns * rows]);
+
+  // each tileStarts is now where its tile ends, so filling backwards leaves it where the tile begins
+  for (int d = draws.size() - 1; d >= 0; --d) {
+    if (!draws[d].binned) continue;
+    for (int i = draws[d].endTriangle - 1; i >= draws[d].firstTriangle; --i) {
+      if (isFlat(triangles[i]) || !getTileRange(screen, getTrianglesRect(triangles, i, i + 1), range)) continue;
+      for (int row = range[2]; row <= range[3]; ++row) {
+        for (int column = range[0]; column <= range[1]; ++column) {
+          if (everyTile || dirtyTiles[row * columns + column]) tileTriangles[--tileStarts[row * columns + column]] = i;
+        }
+      }
+    }
+  }
+}
+
+ScreenRect Renderer::getTileBounds(Screen& screen, int tile) {
+  int firstColumn = (tile % columns) * TILE_WIDTH;
+  int lastColumn = std::min(firstColumn + TILE_WIDTH, screen.width) - 1;
+  int firstRow = (tile / columns) * TILE_HEIGHT;
+  int lastRow = std::min(firstRow + TILE_HEIGHT, screen.height) - 1;
+  return ScreenRect{ firstColumn - screen.width / 2, lastColumn - screen.width / 2, screen.height / 2 - lastRow, screen.height / 2 - firstRow };
+}
@@ -5,44 +5,913 @@
 #include <algorithm>
 #include <cmath>
 #include <array>
-#include <tuple>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <deque>
+#include <memory>
+#include <type_traits>
 
 const float PI = 3.14159265358979323846;
 
-void clearScreen();
+// a 3x4 affine transform, each row is { x, y, z, translation }
+typedef std::array<std::array<float, 4>, 3> Matrix;
+
+Matrix getIdentityMatrix();
+Matrix getRotationMatrix(float yaw, float pitch, float roll);
+Matrix getTranslationMatrix(float x, float y, float z);
+Matrix multiplyMatrices(const Matrix& a, const Matrix& b);
+std::array<float, 3> transformVertex(const Matrix& matrix, std::array<float, 3> vertex);
+std::array<float, 3> rotateDirection(const Matrix& matrix, std::array<float, 3> direction);
+float getScale(const Matrix& matrix);
+Matrix invertMatrix(const Matrix& matrix);
+void orthonormalise(Matrix& matrix);
+
+// where the scene is viewed from
+struct Camera {
+  std::array<float, 3> position;
+  std::array<float, 3> rotation;
+  int focalLength;
+  float nearPlane = 1; // anything closer than this ( in front of the camera ) is clipped off
+
+  Matrix getViewMatrix() const;
+};
+
+// clipping planes in camera space, as outcode bits
+const int CLIP_NEAR = 1;
+const int CLIP_LEFT = 2;
+const int CLIP_RIGHT = 4;
+const int CLIP_BOTTOM = 8;
+const int CLIP_TOP = 16;
+
+// triangles are only clipped at the sides once they reach this far from the centre of the screen,
+// anything closer in is left to the rasterizer, which only visits the on-screen part anyway
+const float GUARD_BAND = 8192;
+
+// a triangle clipped against all five planes has at most eight vertices
+typedef std::array<std::array<float, 3>, 8> ClippedPolygon;
+
+int getOutcode(std::array<float, 3> vertex, float nearPlane, int focalLength);
+int clipPolygon(ClippedPolygon& polygon, int count, int planes, float nearPlane, int focalLength);
+
+// parts of a frame that are timed
+enum ProfileStage {
+  STAGE_TRANSFORM, // vertices into camera space and onto the screen
+  STAGE_SHADE, // culling, lighting and clipping faces
+  STAGE_BIN, // sorting triangles into tiles
+  STAGE_RASTER, // filling every tile, as wall time
+  STAGE_FILL, // clearing tiles, edge setup and addPoint, summed over every worker
+  STAGE_ENCODE, // turning the screen into terminal output
+  STAGE_WRITE, // writing it to the terminal
+  STAGE_COUNT
+};
+
+// things that are counted every frame
+enum ProfileCounter {
+  COUNTER_FACES, // faces of every mesh drawn
+  COUNTER_FACES_CULLED,
+  COUNTER_FACES_CACHED, // faces whose triangles were reused from the last frame instead of being worked out again
+  COUNTER_LOD_FACES_SAVED, // faces left out by drawing a simpler version of a mesh that is small on the screen
+  COUNTER_TRIANGLES, // triangles handed to the rasterizer, after clipping
+  COUNTER_TILE_TRIANGLES, // edge setups, one per triangle per tile it touches
+  COUNTER_PIXELS_TESTED, // points given to addPoint
+  COUNTER_PIXELS_WRITTEN, // points that passed the zbuffer test
+  COUNTER_HIZ_TRIANGLES, // triangles skipped in a tile because every cell there was already nearer
+  COUNTER_HIZ_TILES, // tiles where that cut the rest of the triangles off
+  COUNTER_BYTES_WRITTEN, // terminal output
+  COUNTER_COUNT
+};
+
+struct FrameProfile {
+  std::array<double, STAGE_COUNT> milliseconds;
+  std::array<long long, COUNTER_COUNT> counts;
+};
+
+// collects the timings and counters of each frame. building with RENDERER_NO_PROFILE removes every
+// timer and counter from the hot paths.
+class Profiler {
+public:
+  Profiler();
+  void beginFrame();
+  void endFrame();
+  void addTime(int stage, double milliseconds);
+  void addCount(int counter, long long amount);
+  void addProfile(const FrameProfile& profile);
+  const FrameProfile& getLastFrame();
+  FrameProfile getAverage();
+  int getAverageFrameCount();
+  void resetAverage();
+
+  static const char* getStageName(int stage);
+  static const char* getCounterName(int counter);
+  static void appendSummary(std::string& output, const FrameProfile& frame);
+  static void writeCsvHeader(std::ostream& stream);
+  static void writeCsv(std::ostream& stream, const FrameProfile& frame);
+  static void writeJson(std::ostream& stream, const FrameProfile& frame);
+
+private:
+  FrameProfile current;
+  FrameProfile last;
+  FrameProfile total;
+  int totalFrames;
+  bool inFrame;
+};
+
+// adds the time until the end of the scope to a stage
+class ScopedTimer {
+public:
+  ScopedTimer(Profiler& timedProfiler, int timedStage);
+  ~ScopedTimer();
+
+private:
+  Profiler& profiler;
+  int stage;
+  std::chrono::steady_clock::time_point start;
+};
+
+#ifndef RENDERER_NO_PROFILE
+#define PROFILE_SCOPE(profiler, stage) ScopedTimer profileTimer(profiler, stage)
+#define PROFILE_COUNT(profiler, counter, amount) (profiler).addCount(counter, amount)
+#else
+#define PROFILE_SCOPE(profiler, stage)
+#define PROFILE_COUNT(profiler, counter, amount)
+#endif
+
+// a single character cell of the screen buffer
+struct Cell {
+  char letter;
+  unsigned char colour; // index into the colour palette, 0 is the terminal default
+};
+
+unsigned char getColourIndex(std::string colour);
+const std::string& getColourCode(unsigned char index);
+
+// an inclusive rectangle of points, in screen coordinates ( origin at the centre, y up )
+struct ScreenRect {
+  int minX;
+  int maxX;
+  int minY;
+  int maxY;
+};
 
 class Screen {
 public:
   int width;
   int height;
-  std::vector<std::string> buffer;
+  std::vector<Cell> buffer;
   std::vector<float> zBuffer;
+  std::vector<float> tieBuffer; // averageOoz of the triangle each cell came from, to settle equal ooz whatever the order
 
   Screen(int w, int h);
   void emptyBuffer();
   void emptyZBuffer();
-  void drawBuffer();
   bool isInScreen(std::array<int, 2> vertex);
-  void addPoint(std::array<int, 2> point, float ooz, char letter, std::string colour, float averageOoz);
+  ScreenRect getBounds() const;
+  bool addPoint(std::array<int, 2> point, float ooz, char letter, unsigned char colour, float averageOoz);
+  void stretch(const Screen& smaller, int scale);
+};
+
+// encodes screens as terminal output, sending only what changed since the previous frame
+class FrameEncoder {
+public:
+  std::string output;
+  Profiler* profiler = nullptr; // times encoding and writing when set
+
+  FrameEncoder();
+  void reset();
+  void present(const Screen& screen);
+  const std::string& encode(const Screen& screen);
+  void write();
+
+private:
+  std::vector<Cell> previous; // the frame the terminal is currently showing
+  int width;
+  int height;
+  bool hasPrevious;
+  unsigned char currentColour;
+  int cursorRow;
+  int cursorColumn;
+
+  bool sameCell(Cell a, Cell b);
+  void appendCell(Cell cell);
+  void moveCursor(int row, int column);
+  void appendNumber(int number);
+};
+
+// paces frames on the steady clock. each frame is due one period after the previous one, and a frame
+// that starts after it was due is missed. when late frames are dropped the schedule skips the periods
+// that have already passed, otherwise it keeps the old deadlines and runs frames back to back to catch up.
+class FrameScheduler {
+public:
+  FrameScheduler(float framesPerSecond, bool dropLateFrames);
+  void waitForNextFrame();
+  int getMissedFrames();
+  int getDroppedFrames();
+
+private:
+  std::chrono::steady_clock::duration period;
+  std::chrono::steady_clock::time_point deadline;
+  bool dropLateFrames;
+  bool started;
+  int missedFrames;
+  int droppedFrames;
+};
+
+// what happens when a frame is submitted before the previous one has started being written
+enum PresentPolicy {
+  PRESENT_EVERY_FRAME, // submit waits, every frame is shown
+  PRESENT_LATEST, // the newer frame replaces the waiting one, submit never waits
+};
+
+struct PresenterStats {
+  int presented;
+  int replaced; // frames that were never shown because a newer one replaced them
 };
 
-class Triangle {
+// encodes and writes frames on its own thread, so the next frame can be drawn while the last one is
+// being written. submit swaps the screen's buffer with a waiting one instead of copying it.
+class FramePresenter {
 public:
-  std::array<std::array<float, 3>, 3> vertices;
+  FramePresenter(PresentPolicy presentPolicy);
+  ~FramePresenter();
+  void submit(Screen& screen, const std::string& footer);
+  PresenterStats getStats();
+  FrameProfile takeProfile();
+
+  bool copyScreens = false; // copy instead of swapping, so the screen keeps its frame for incremental rendering
+
+private:
+  PresentPolicy policy;
+  FrameEncoder encoder;
+  Profiler profiler; // only used by the presenting thread
+  Screen pending;
+  Screen presenting;
+  std::string pendingFooter;
+  std::string presentingFooter;
+  bool hasPending;
+  bool stopping;
+  PresenterStats stats;
+  FrameProfile collected; // encode and write times since the last takeProfile
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::thread thread;
+
+  void presentLoop();
+};
+
+struct ServerStats {
+  int clients;
+  long long framesQueued; // frames queued for clients, counting once per client
+  long long framesDropped; // frames thrown away because a client had fallen too far behind
+  long long keyframes;
+};
+
+// renders once and streams to many viewers. every frame is encoded once as the changes since the last
+// one, and now and then ( or whenever a viewer is waiting for one ) in full as a keyframe, and the same
+// bytes are queued for every client. a thread of its own accepts clients and writes to them without
+// blocking, so a slow client only falls behind itself: once its queue is full what is waiting is
+// dropped and it picks up again at the next keyframe
+class FrameServer {
+public:
+  FrameServer();
+  ~FrameServer();
+  bool listen(const std::string& address);
+  void broadcast(const Screen& screen);
+  bool waitUntilSent(int milliseconds);
+  ServerStats getStats();
+
+  int keyframeInterval = 60; // frames between keyframes
+  int maxQueuedFrames = 8; // frames a client can fall behind before it skips to the next keyframe
+
+private:
+  struct Client {
+    int socket;
+    std::deque<std::shared_ptr<const std::string>> queue;
+    size_t sent; // bytes of the front frame already written
+    bool waitingForKeyframe;
+  };
+
+  FrameEncoder deltaEncoder;
+  FrameEncoder keyframeEncoder;
+  int framesSinceKeyframe;
+  int listenSocket;
+  int wakePipe[2];
+  std::string socketPath; // removed again when the server stops
+  std::vector<Client> clients;
+  ServerStats stats;
+  bool stopping;
+  std::mutex mutex;
+  std::condition_variable sent;
+  std::thread thread;
+
+  void serveLoop();
+  void wakeThread();
+  bool writeClient(Client& client);
+  bool isIdle();
+};
+
+// connects to a frame server, -1 if it can't
+int connectToFrameServer(const std::string& address);
+
+// a triangle after projection and lighting, ready to be filled
+struct ScreenTriangle {
+  std::array<std::array<int, 2>, 3> points;
+  std::array<float, 3> depths;
+  float averageOoz; // used to determine which point to show when ooz is the same
+  char letter;
+  unsigned char colour;
+
+  // smooth shaded triangles choose a letter for every point from the shade at each corner instead
+  const char* letters = nullptr; // null for flat shaded triangles
+  int letterCount = 0;
+  std::array<float, 3> shades = { 0, 0, 0 }; // 0 fully lit to 1 unlit
+};
+
+// what a face is filled with. materials are kept in one table shared by every mesh, and faces refer
+// to them by id.
+struct Material {
   std::vector<char> letters; // lightest first
-  std::string colour;
-  Triangle(std::array<std::array<float, 3>, 3> points, std::vector<char>& fillLetters, std::string triangleColour); 
-  void draw(Screen& screen, std::array<float, 3> cameraPos, std::array<float, 3> cameraRot, int focalLength, std::vector<std::array<float,4>> lightSources);
-  void rotate(float yaw, float roll, float pitch);
-  void translate(float x, float y, float z);
+  unsigned char colour;
+  bool smooth; // light each vertex and blend across the face instead of lighting the face once
+};
+
+unsigned short getMaterialId(const std::vector<char>& letters, const std::string& colour, bool smooth = false);
+const Material& getMaterial(unsigned short id);
+int getMaterialCount();
 
-  std::array<std::array<float,3>, 3> rotateVertices(std::array<std::array<float,3>,3> oldVertices, float yaw, float pitch, float roll);
-  std::array<std::array<float,3>,3> translateVertices(std::array<std::array<float,3>,3> oldVertices, float x, float y, float z);
+// an axis aligned box
+struct BoundingBox {
+  std::array<float, 3> min;
+  std::array<float, 3> max;
+};
+
+struct BvhNode {
+  BoundingBox bounds;
+  int first; // the first of its two children ( always next to each other ), or of a leaf's items
+  int count; // items in a leaf, 0 for a node with children
+};
+
+// a bounding volume hierarchy over boxes, so rays and frustums can skip most of them. each node is split
+// where the surface area heuristic says is cheapest, trying a fixed number of bins along each axis,
+// or down the middle once it gets too deep so queries can use a fixed stack. children always come
+// after their parent, so refitting is one pass backwards
+class Bvh {
+public:
+  static const int BINS = 16;
+  static const int MAX_LEAF_ITEMS = 8;
+  static const int SAH_DEPTH = 48; // deeper nodes are split in half by count
+  static const int STACK_SIZE = 128; // enough for any query, given SAH_DEPTH
+
+  std::vector<BvhNode> nodes;
+  std::vector<int> items; // indices of the boxes it was built over, each leaf owning a range of them
+
+  void build(const std::vector<BoundingBox>& boxes);
+  void refit(const std::vector<BoundingBox>& boxes);
+};
+
+// an indexed triangle mesh. vertex positions are kept in separate x, y and z arrays and shared by
+// every face that uses them, faces are three indices into them and a material.
+class Mesh {
+public:
+  std::vector<float> xs;
+  std::vector<float> ys;
+  std::vector<float> zs;
+  std::vector<int> indices; // three per face
+  std::vector<unsigned short> faceMaterials; // material id, one per face
+  bool closed = false; // faces wind anticlockwise seen from outside and there are no holes, so back faces can be skipped
+  bool smooth = false; // shade every face smoothly, whatever its material says
+
+  // unit normals in the mesh's coordinates, kept up to date by updateNormals. vertex normals are the
+  // area weighted average of the faces around them.
+  std::vector<float> faceNormalXs;
+  std::vector<float> faceNormalYs;
+  std::vector<float> faceNormalZs;
+  std::vector<float> vertexNormalXs;
+  std::vector<float> vertexNormalYs;
+  std::vector<float> vertexNormalZs;
 
-  std::array<float,3> rotateVertex(std::array<float,3> oldVertex, float yaw, float pitch, float roll);
-  std::array<float,3> translateVertex(std::array<float,3> oldVertex, float x, float y, float z);
+  // bounds of the vertices, kept up to date by updateBounds
+  std::array<float, 3> boundsMin = { 0, 0, 0 };
+  std::array<float, 3> boundsMax = { 0, 0, 0 };
+  std::array<float, 3> boundsCentre = { 0, 0, 0 };
+  float boundsRadius = 0;
+
+  // simpler versions for when the mesh covers few cells, each with about half the faces of the one before
+  std::vector<Mesh> lods;
+
+  // over the faces in the mesh's coordinates, for picking. only there once buildBvh has been called
+  Bvh bvh;
+
+  int getVertexCount() const;
+  int getFaceCount() const;
+  int addVertex(std::array<float, 3> vertex);
+  void addFace(int a, int b, int c, int material);
+  void updateBounds();
+  void updateNormals();
+  void fit(float radius);
+  void setSmooth(bool enabled);
+  void buildLods(int minFaces = 64);
+  void buildBvh();
 };
 
+bool raycastMesh(const Mesh& mesh, std::array<float, 3> origin, std::array<float, 3> direction, float& distance, int& face, bool useBvh = true);
+
+Mesh simplifyMesh(const Mesh& mesh, int targetFaces);
+
+// mesh files, each loader returns false when the file can't be read or isn't valid
+bool loadObj(const std::string& path, Mesh& mesh, std::vector<char>& letters, std::string colour);
+bool loadStl(const std::string& path, Mesh& mesh, std::vector<char>& letters, std::string colour);
+bool loadMeshCache(const std::string& path, Mesh& mesh);
+bool saveMeshCache(const std::string& path, const Mesh& mesh);
+bool loadMesh(const std::string& path, Mesh& mesh, std::vector<char>& letters, std::string colour);
+
 std::array<int, 2> get2dPos(std::array<float, 3> pos, int focalLength);
 
-std::tuple<std::vector<std::array<int,2>>, std::vector<float>> getPoints(Screen& screen, std::array<int, 2> startPos, float startDepth, std::array<int, 2> endPos, float endDepth);
+// the arrays a vertex kernel reads and writes, each with count entries
+struct VertexBatch {
+  const float* xs;
+  const float* ys;
+  const float* zs;
+  float* cameraXs;
+  float* cameraYs;
+  float* cameraZs;
+  int* screenXs;
+  int* screenYs;
+  int count;
+};
+
+void transformVertices(const Matrix& matrix, int focalLength, const VertexBatch& batch);
+const char* getVertexKernelName();
+bool setVertexKernel(std::string name);
+bool checkVertexKernels();
+
+// the arrays a light kernel reads and writes, each with count entries. normals ( which need not be
+// unit length ) and the points light is measured from are in camera space.
+struct LightBatch {
+  const float* normalXs;
+  const float* normalYs;
+  const float* normalZs;
+  const float* pointXs;
+  const float* pointYs;
+  const float* pointZs;
+  float* shades; // 0 fully lit to 1 unlit
+  int count;
+};
+
+void lightSurfaces(const std::vector<std::array<float, 4>>& lightSources, const LightBatch& batch);
+
+// what one worker did while filling tiles, kept apart from the other workers' until the end of a frame
+struct alignas(64) RasterStats {
+  long long triangles;
+  long long pixelsTested;
+  long long pixelsWritten;
+  long long hizTriangles;
+  long long hizTiles;
+  double fillMilliseconds;
+};
+
+float getNearestOoz(const ScreenTriangle& triangle);
+int fillTriangle(Screen& screen, const ScreenTriangle& triangle, ScreenRect clip, RasterStats& stats);
+
+// how many faces were rejected at each culling step since the last setCamera
+struct CullStats {
+  int faces; // faces of every mesh drawn
+  int culledByModel; // faces of meshes whose bounding sphere is outside the view
+  int culledByClipping; // entirely behind the near plane or outside the guard band
+  int culledBackFacing;
+  int culledOffScreen;
+  int drawn;
+};
+
+// one copy of an instanced mesh
+struct Instance {
+  Matrix transform; // from the mesh's coordinates into those of whatever holds the instances
+  int material; // material id for every face instead of the mesh's own, or -1
+};
+
+// the triangles a mesh was drawn as, reused while neither its transform nor the camera changes
+struct DrawCache {
+  std::vector<ScreenTriangle> triangles;
+  CullStats cullStats;
+  ScreenRect bounds; // around every triangle, not clipped to the screen
+  int cameraVersion = -1; // the renderer's camera version when they were made, -1 once out of date
+  bool moving = false; // the transform changed this frame, so the triangles are not worth keeping
+  std::vector<unsigned char> lodLevels; // level of detail last drawn, one per instance
+};
+
+// the triangles one drawMesh call added to a frame, for working out what changed since the last one
+struct DrawRecord {
+  int firstTriangle;
+  int endTriangle;
+  ScreenRect bounds; // around every triangle, empty when minX > maxX
+  const DrawCache* cache; // the cache holding exactly these triangles, if any
+  bool reused; // they came out of the cache rather than being worked out again
+  bool binned;
+};
+
+// a bump allocator for data that only lives until the end of a frame. allocating moves an offset
+// along a block and reset gives everything back at once. a frame that outgrows the block gets more
+// blocks, and the next reset swaps them for one block big enough for all of it, so once a workload
+// has been seen the arena never allocates again
+class FrameArena {
+public:
+  // a point to go back to, giving back everything allocated since
+  struct Mark {
+    int block;
+    size_t offset;
+    size_t used;
+  };
+
+  // room for count values of T, uninitialised
+  template <typename T>
+  T* allocate(size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value, "arena memory is given back without destroying anything");
+    return (T*)allocateBytes(count * sizeof(T), alignof(T));
+  }
+
+  Mark getMark() const;
+  void rewind(const Mark& mark);
+  void reset();
+  size_t getUsed() const;
+  size_t getHighWater() const;
+  void resetHighWater();
+  size_t getCapacity() const;
+
+private:
+  std::vector<std::unique_ptr<char[]>> blocks;
+  std::vector<size_t> blockSizes;
+  int block = 0;
+  size_t offset = 0;
+  size_t used = 0; // bytes handed out ( with padding ) since the last reset
+  size_t highWater = 0;
+
+  void* allocateBytes(size_t bytes, size_t alignment);
+};
+
+// the most the renderer's arenas have held at once, for sizing them
+struct ArenaStats {
+  size_t frameBytes; // geometry of the mesh being drawn, and the tile lists
+  size_t workerBytes; // the largest of the workers' arenas, which sort one tile at a time
+  size_t capacityBytes; // reserved by every arena together
+};
+
+// how faces are lit, from the best looking to the cheapest
+enum LightingMode {
+  LIGHTING_SMOOTH, // as each material says, smooth ones lit at every vertex
+  LIGHTING_FLAT, // every face lit once, even smooth ones
+  LIGHTING_NONE, // not lit at all, every face shows its material's first letter
+};
+
+// what the renderer can trade for time. the defaults draw everything in full
+struct QualitySettings {
+  int resolutionScale = 1; // the frame is filled at 1 / scale of the screen's width and height, and each cell stretched over scale x scale
+  float lodBias = 1; // multiplies the faces a mesh is given per cell it covers, below 1 picks simpler versions sooner
+  LightingMode lighting = LIGHTING_SMOOTH;
+  int maxLights = -1; // only the strongest lights are worked out, -1 for all of them
+
+  bool operator==(const QualitySettings& other) const;
+  bool operator!=(const QualitySettings& other) const { return !(*this == other); }
+};
+
+// the things a quality governor can turn down
+enum QualityKnob {
+  KNOB_LOD_BIAS,
+  KNOB_LIGHTING,
+  KNOB_LIGHTS,
+  KNOB_RESOLUTION,
+  KNOB_COUNT
+};
+
+// one change a quality governor made, and what it saw when it made it
+struct QualityDecision {
+  long long frame;
+  QualityKnob knob;
+  bool lowered; // turned down, otherwise back up
+  double milliseconds; // the average frame it was deciding on
+  int stage; // the stage that took longest then ( a ProfileStage )
+};
+
+// turns quality down when frames take longer than a budget, and back up when there is room again.
+// it watches the average of the last few frames' transform, shade, bin and raster times, and lowers
+// whichever knob helps the stage taking longest ( resolution for raster, lighting for shade, level of
+// detail for transform and bin ). knobs go back up in the reverse order, once frames fit well under
+// the budget. to stop it swinging between two settings it waits a while after every change, only
+// raises once frames are well under budget, and waits twice as long to raise each time a raise had
+// to be taken back straight away
+class QualityGovernor {
+public:
+  QualityGovernor(double frameBudgetMilliseconds);
+  bool update(const FrameProfile& frame);
+  const QualitySettings& getSettings() const;
+  int getLevel() const;
+  double getAverageMilliseconds() const;
+  const std::vector<QualityDecision>& getDecisions() const;
+  static const char* getKnobName(int knob);
+  static void appendSummary(std::string& output, const QualityGovernor& governor);
+
+  double budgetMilliseconds;
+  int windowFrames = 15; // frames averaged before deciding
+  double raiseBelow = 0.6; // fraction of the budget frames have to fit in before quality goes back up
+  int maxDecisions = 64; // decisions kept, the oldest go first
+
+private:
+  QualitySettings settings;
+  std::vector<FrameProfile> window; // the last windowFrames frames, oldest at windowNext once full
+  int windowNext;
+  int windowCount;
+  double average;
+  long long frame;
+  long long lastChange; // frame of the last decision
+  long long lastRaise;
+  int raiseWait; // frames to wait after a change before raising
+  std::vector<QualityKnob> lowered; // every knob turned down and not yet back up, the latest last
+  std::vector<QualityDecision> decisions;
+
+  bool lower(QualityKnob knob);
+  bool raise(QualityKnob knob);
+  void record(QualityKnob knob, bool down, int stage);
+};
+
+// a fixed set of threads that share out numbered tasks, the calling thread joins in as worker 0
+class WorkerPool {
+public:
+  WorkerPool(int threadCount);
+  ~WorkerPool();
+  int getThreadCount();
+  void setThreadCount(int threadCount);
+
+  // calls function(task, worker) once for every task in [0, taskCount) and waits for them all
+  template <typename Function>
+  void run(int taskCount, Function& function) {
+    runTasks(taskCount, [](void* context, int task, int worker) { (*(Function*)context)(task, worker); }, &function);
+  }
+
+private:
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable finished;
+  void (*taskFunction)(void*, int, int);
+  void* taskContext;
+  int taskCount;
+  std::atomic<int> nextTask;
+  int busyWorkers;
+  int generation;
+  bool stopping;
+
+  void startThreads(int threadCount);
+  void stopThreads();
+  void workerLoop(int worker, int seenGeneration);
+  void runTasks(int count, void (*function)(void*, int, int), void* context);
+  void doTasks(int worker);
+};
+
+// collects the projected triangles of a frame, bins them into screen tiles and fills the tiles in parallel.
+// every tile is filled by one worker in submission order, so the result matches drawing them one by one.
+class Renderer {
+public:
+  static const int TILE_WIDTH = 16;
+  static const int TILE_HEIGHT = 8;
+  // a mesh small on the screen is drawn with about this many faces per cell it covers, and only
+  // changes level once its size is this factor past where the choice changes
+  static constexpr float LOD_FACES_PER_CELL = 2;
+  static constexpr float LOD_HYSTERESIS = 1.25f;
+  static constexpr unsigned char LOD_UNKNOWN = 255;
+
+  Renderer(int threadCount);
+  void setThreadCount(int threadCount);
+  int getThreadCount();
+  void submit(const ScreenTriangle& triangle);
+  void setCamera(const Camera& frameCamera, const std::vector<std::array<float,4>>& lightSources, const Screen& screen);
+  void drawMesh(const Mesh& mesh, const Matrix& transform, DrawCache* cache = nullptr);
+  void drawInstances(const Mesh& mesh, const Matrix& transform, const std::vector<Instance>& instances, DrawCache* cache = nullptr);
+  void render(Screen& screen);
+  void setIncremental(bool enabled);
+  CullStats getCullStats();
+  ArenaStats getArenaStats();
+  void resetArenaStats();
+  std::array<std::array<float, 4>, 5> getWorldFrustum();
+  void countCulledMesh(const Mesh& mesh);
+  void setQuality(const QualitySettings& settings);
+  const QualitySettings& getQuality();
+
+  Profiler profiler;
+
+private:
+  WorkerPool workers;
+  Camera camera;
+  std::vector<std::array<float, 4>> worldLights;
+  int cameraVersion; // changes whenever the camera, lights or screen differ from the last frame's
+  bool cameraSettled; // nothing changed since the last frame, so caches are worth filling
+  Matrix viewMatrix;
+  ScreenRect screenBounds;
+  std::array<std::array<float, 4>, 5> frustumPlanes; // unit normal and offset, points inside are >= 0
+  CullStats cullStats;
+  std::vector<std::array<float, 4>> cameraLights; // light positions in camera space and their strengths
+  QualitySettings quality; // what this frame is drawn with
+  QualitySettings nextQuality; // taken up at the next setCamera, so a frame is drawn with one setting throughout
+  Screen scaledScreen; // filled instead of the screen and stretched over it, when the resolution is scaled
+
+  // everything that only lasts until the frame is rendered ( or a mesh is drawn ) comes from here,
+  // given back all at once. each worker has its own for the tile it is filling
+  FrameArena frameArena;
+  std::vector<FrameArena> workerArenas;
+
+  bool reuseCache(DrawCache* cache);
+  void finishDraw(int firstTriangle, const CullStats& before, DrawCache* cache);
+  bool isOutsideView(const std::array<float, 3>& centre, float radius);
+  void drawCopy(const Mesh& mesh, const Matrix& modelView, const Matrix* instance, const std::array<float, 3>& centre, float scale, int material, unsigned char* level);
+  void projectMesh(const Mesh& mesh, const Matrix& modelView, int material);
+  const Mesh& selectLod(const Mesh& mesh, float radius, float depth, unsigned char* level);
+  void submitClipped(ScreenTriangle& projected, std::array<std::array<float, 3>, 3> vertices, int planes);
+  std::vector<ScreenTriangle> triangles;
+  void recordDraw(int firstTriangle, const DrawCache* cache, bool reused, ScreenRect bounds);
+  void closeDraws();
+
+  // incremental rendering only fills tiles where a draw was added, changed or taken away since the
+  // last render, keeping the rest of the screen as it was
+  bool incremental;
+  std::vector<DrawRecord> draws;
+  std::vector<DrawRecord> lastDraws;
+  std::vector<const DrawCache*> lastCaches; // sorted, of the last frame's draws
+  const Cell* lastBuffer; // the buffer last rendered into, and its size
+  int lastWidth;
+  int lastHeight;
+  // the tiles being filled this frame, and indices into triangles grouped by tile, tile i owning
+  // [tileStarts[i], tileStarts[i + 1]). all in the frame arena, so only valid during render
+  unsigned char* dirtyTiles;
+  int* tilesToFill;
+  int tilesToFillCount;
+  int* tileStarts;
+  int* tileTriangles;
+  float* triangleKeys; // nearest ooz of each triangle, every tile is filled nearest first
+  std::vector<RasterStats> workerStats;
+  int columns;
+  int rows;
+
+  void fillScreen(Screen& screen);
+  void markDirtyTiles(Screen& screen);
+  void markDirtyRect(Screen& screen, ScreenRect rect);
+  void binTriangles(Screen& screen, bool everyTile);
+  bool getTileRange(Screen& screen, ScreenRect rect, std::array<int, 4>& range);
+  ScreenRect getTileBounds(Screen& screen, int tile);
+};
+
+class Model {
+public:
+  Mesh mesh;
+  Matrix transform; // from the mesh's coordinates into the world, kept up to date by the scene it is in
+
+  Model(Mesh modelMesh);
+  Model(std::vector<std::array<std::array<float,3>,3>> sides, std::vector<char>& fillLetters, std::vector<std::string>& colours);
+  void rotate(float yaw, float pitch, float roll);
+  void translate(float x, float y, float z);
+  void draw(Renderer& renderer);
+};
+
+Model makeCube(std::array<float, 3> centre, float sideLength, std::vector<char>& letters, std::vector<std::string>& colours);
+Mesh makeTorus(float majorRadius, float minorRadius, int rings, int sides, std::vector<char>& letters, std::string colour);
+
+// one mesh drawn many times, each instance placed relative to the node holding them
+struct InstancedModel {
+  Mesh mesh;
+  std::vector<Instance> instances;
+};
+
+// a point in a scene's hierarchy: a transform relative to its parent, and optionally a model drawn with it
+struct SceneNode {
+  Matrix local; // from this node's coordinates into its parent's
+  Matrix world; // from this node's coordinates into the world
+  int parent; // index into Scene::nodes, always before this node, or -1 at the top
+  int model; // index into Scene::models, or -1
+  int instanced; // index into Scene::instancedModels, or -1
+  std::array<float, 3> spin; // yaw, pitch and roll added to local every frame
+  bool dirty; // local has changed since world was worked out
+  bool moved; // world changed in the last updateTransforms
+  DrawCache cache; // the model's triangles, while neither world nor the camera changes
+};
+
+class SceneBvh;
+
+// a node turning and moving at a steady rate, from where it starts
+struct NodeTrack {
+  int node;
+  std::array<float, 3> spin; // yaw, pitch and roll each frame, about its parent's origin
+  std::array<float, 3> velocity; // moved each frame, in its parent's coordinates
+};
+
+// what a scene does over time, written so that any frame can be posed straight from the start
+// without going through the frames before it
+struct Timeline {
+  int frameCount = 0;
+  std::vector<NodeTrack> tracks;
+  std::array<float, 3> cameraVelocity = { 0, 0, 0 };
+  std::array<float, 3> cameraSpin = { 0, 0, 0 };
+};
+
+// the models, camera and lights of a scene, placed by a tree of nodes. world transforms are only
+// worked out again below nodes that changed, and models that did not move are drawn from their cache
+struct Scene {
+  std::vector<Model> models;
+  std::vector<InstancedModel> instancedModels;
+  std::vector<SceneNode> nodes;
+  Camera camera;
+  std::vector<std::array<float, 4>> lightSources;
+
+  int addNode(int parent, const Matrix& local, std::array<float, 3> spin = { 0, 0, 0 });
+  int addModel(Model model, int parent = -1, std::array<float, 3> spin = { 0, 0, 0 });
+  int addInstancedModel(Mesh mesh, int parent = -1, std::array<float, 3> spin = { 0, 0, 0 });
+  void rotateNode(int node, float yaw, float pitch, float roll);
+  void translateNode(int node, float x, float y, float z);
+  void markDirty(int node);
+  void update();
+  void updateTransforms();
+  void drawModels(Renderer& renderer, const Screen& screen, SceneBvh* bvh = nullptr);
+  void draw(Renderer& renderer, Screen& screen, SceneBvh* bvh = nullptr);
+  void pose(const Scene& start, const Timeline& timeline, int frame);
+};
+
+Timeline makeSpinTimeline(const Scene& scene, int frameCount);
+
+// one placed copy of a mesh in a SceneBvh
+struct BvhObject {
+  int node;
+  int instance; // index into the node's instances, or -1 for its model
+  Matrix transform; // from the mesh's coordinates into the world
+  Matrix inverse;
+  BoundingBox bounds; // in the world
+};
+
+// the nearest face a ray hit
+struct RayHit {
+  int node;
+  int instance; // -1 for a model
+  int face;
+  float distance; // along the ray, in lengths of its direction
+  std::array<float, 3> point; // in the world
+};
+
+struct BvhStats {
+  int objects;
+  long long triangles; // faces of every object
+  double buildMilliseconds; // the last build, including any mesh that needed its own bvh
+  double refitMilliseconds; // the last refit
+  int refitObjects; // objects that had moved at the last refit
+};
+
+// a two level bvh over every triangle of a scene in the world. each mesh has one over its own faces
+// in its own coordinates ( Mesh::bvh, shared by every copy of it ) and this one is over the models
+// and instances placed in the world, so moving a model only changes its box here and never touches a
+// triangle. rays and planes are taken into a mesh's coordinates to go through its faces
+class SceneBvh {
+public:
+  void build(Scene& scene);
+  void refit(const Scene& scene);
+  bool raycast(const Scene& scene, std::array<float, 3> origin, std::array<float, 3> direction, RayHit& hit) const;
+  bool pick(const Scene& scene, const Screen& screen, int column, int row, RayHit& hit) const;
+  void queryFrustum(const Scene& scene, const std::array<std::array<float, 4>, 5>& planes);
+  bool isNodeVisible(int node) const;
+  const std::vector<BvhObject>& getObjects() const;
+  const BvhStats& getStats() const;
+
+private:
+  Bvh top;
+  std::vector<BvhObject> objects;
+  std::vector<BoundingBox> boxes; // the world bounds of each object, what top is built over
+  std::vector<Matrix> worlds; // every scene node's world transform, worked out from the locals
+  std::vector<unsigned char> visibleNodes; // from the last queryFrustum, one per scene node
+  BvhStats stats = {};
+
+  int updateObjects(const Scene& scene);
+  bool isMeshInside(const Mesh& mesh, const Matrix& transform, const std::array<std::array<float, 4>, 5>& planes) const;
+};
+
+// how renderBatch writes frames
+enum BatchFormat {
+  BATCH_CELLS, // width x height cells a frame, top row first, each a letter and an sgr colour number ( 0 for the default )
+  BATCH_ANSI, // terminal output, each frame only the changes from the one before, as the demo writes it
+  BATCH_PPM, // a binary ppm image a frame, each cell one pixel wide and two high, brighter for denser letters
+};
+
+struct BatchStats {
+  int frames;
+  long long bytes;
+  double milliseconds; // from the start of the first frame until the last was written
+};
+
+bool getBatchFormat(const std::string& name, BatchFormat& format);
+BatchStats renderBatch(const Scene& scene, const Timeline& timeline, int width, int height, int threadCount, BatchFormat format, std::ostream& output);
+
+Scene makeDemoScene();
+Scene makeCloseUpScene();
+Scene makeManyCubesScene();
+Scene makeMostlyStaticScene();
+Scene makeInstancesScene();
+Scene makeLargeMeshScene();
+Scene makeLodScene();
+Scene makeMeshScene(Mesh mesh);
+
+extern std::vector<char> defaultLetters;
@@ -0,0 +1,370 @@
+#include "renderer.hpp"
+
+Model makeCube(std::array<float, 3> centre, float sideLength, std::vector<char>& letters, std::vector<std::string>& colours) {
+  // create a cube, every face winds anticlockwise when seen from outside
+  std::array<std::array<float, 3>, 3> face;
+
+  std::vector<std::array<std::array<float,3>,3>> faces;
+
+  std::array<float,3> c1 = {sideLength + centre[0], sideLength + centre[1], sideLength + centre[2]};
+  std::array<float,3> c2 = {-sideLength + centre[0], sideLength + centre[1], sideLength + centre[2]};
+  std::array<float,3> c3 = {sideLength + centre[0], -sideLength + centre[1], sideLength + centre[2]};
+  std::array<float,3> c4 = {-sideLength + centre[0], -sideLength + centre[1], sideLength + centre[2]};
+  std::array<float,3> c5 = {sideLength + centre[0], sideLength + centre[1], -sideLength + centre[2]};
+  std::array<float,3> c6 = {-sideLength + centre[0], sideLength + centre[1], -sideLength + centre[2]};
+  std::array<float,3> c7 = {sideLength + centre[0], -sideLength + centre[1], -sideLength + centre[2]};
+  std::array<float,3> c8 = {-sideLength + centre[0], -sideLength + centre[1], -sideLength + centre[2]};
+
+  face = {c1, c2, c3};
+  faces.push_back(face);
+  face = {c4, c3, c2};
+  faces.push_back(face);
+  face = {c6, c2, c1};
+  faces.push_back(face);
+  face = {c1, c5, c6};
+  faces.push_back(face);
+  face = {c1, c3, c7};
+  faces.push_back(face);
+  face = {c7, c5, c1};
+  faces.push_back(face);
+  face = {c3, c4, c8};
+  faces.push_back(face);
+  face = {c8, c7, c3};
+  faces.push_back(face);
+  face = {c8, c4, c2};
+  faces.push_back(face);
+  face = {c2, c6, c8};
+  faces.push_back(face);
+  face = {c5, c7, c8};
+  faces.push_back(face);
+  face = {c8, c6, c5};
+  faces.push_back(face);
+
+  Model cube(faces, letters, colours);
+  cube.mesh.closed = true;
+
+  return cube;
+}
+
+// a torus around the z axis, every face winds anticlockwise when seen from outside
+Mesh makeTorus(float majorRadius, float minorRadius, int rings, int sides, std::vector<char>& letters, std::string colour) {
+  Mesh mesh;
+  int material = getMaterialId(letters, colour);
+  for (int ring = 0; ring < rings; ++ring) {
+    float u = 2 * PI * ring / rings;
+    for (int side = 0; side < sides; ++side) {
+      float v = 2 * PI * side / sides;
+      float distance = majorRadius + minorRadius * std::cos(v);
+      mesh.addVertex({ distance * std::cos(u), distance * std::sin(u), minorRadius * std::sin(v) });
+    }
+  }
+
+  for (int ring = 0; ring < rings; ++ring) {
+    int nextRing = (ring + 1) % rings;
+    for (int side = 0; side < sides; ++side) {
+      int nextSide = (side + 1) % sides;
+      int a = ring * sides + side;
+      int b = nextRing * sides + side;
+      int c = nextRing * sides + nextSide;
+      int d = ring * sides + nextSide;
+      mesh.addFace(a, b, c, material);
+      mesh.addFace(a, c, d, material);
+    }
+  }
+
+  mesh.closed = true;
+  mesh.updateBounds();
+  return mesh;
+}
+
+// adds a node below parent ( -1 for the top ), parents always come before their children
+int Scene::addNode(int parent, const Matrix& local, std::array<float, 3> spin) {
+  nodes.push_back(SceneNode{ local, local, parent, -1, -1, spin, true, true });
+  return nodes.size() - 1;
+}
+
+// adds a model with a node of its own, placed by the model's transform relative to parent
+int Scene::addModel(Model model, int parent, std::array<float, 3> spin) {
+  int node = addNode(parent, model.transform, spin);
+  nodes[node].model = models.size();
+  models.push_back(std::move(model));
+  return node;
+}
+
+// adds a mesh drawn once for every instance added to scene.instancedModels[nodes[node].instanced].instances
+// ( mark the node dirty after changing them )
+int Scene::addInstancedModel(Mesh mesh, int parent, std::array<float, 3> spin) {
+  int node = addNode(parent, getIdentityMatrix(), spin);
+  nodes[node].instanced = instancedModels.size();
+  mesh.updateBounds();
+  mesh.updateNormals();
+  instancedModels.push_back(InstancedModel{ std::move(mesh), {} });
+  return node;
+}
+
+// rotate a node about its parent's origin by the rotation angles ( in rad )
+void Scene::rotateNode(int node, float yaw, float pitch, float roll) {
+  nodes[node].local = multiplyMatrices(getRotationMatrix(yaw, pitch, roll), nodes[node].local);
+  orthonormalise(nodes[node].local);
+  nodes[node].dirty = true;
+}
+
+void Scene::translateNode(int node, float x, float y, float z) {
+  nodes[node].local[0][3] += x;
+  nodes[node].local[1][3] += y;
+  nodes[node].local[2][3] += z;
+  nodes[node].dirty = true;
+}
+
+// call after changing a node's local transform or its model's mesh directly
+void Scene::markDirty(int node) {
+  nodes[node].dirty = true;
+}
+
+// spins every node by its own angles
+void Scene::update() {
+  for (int i = 0; i < nodes.size(); ++i) {
+    if (nodes[i].spin[0] != 0 || nodes[i].spin[1] != 0 || nodes[i].spin[2] != 0) {
+      rotateNode(i, nodes[i].spin[0], nodes[i].spin[1], nodes[i].spin[2]);
+    }
+  }
+}
+
+// a turn of spin repeated count times, as update would turn a node over count frames. squaring takes
+// about log( count ) products, and turns don't add up by their angles ( the order of yaw, pitch and
+// roll matters ) so the matrix has to be
+static Matrix getRepeatedRotation(const std::array<float, 3>& spin, int count) {
+  Matrix result = getIdentityMatrix();
+  Matrix step = getRotationMatrix(spin[0], spin[1], spin[2]);
+  while (count > 0) {
+    if (count & 1) {
+      result = multiplyMatrices(step, result);
+      orthonormalise(result);
+    }
+    count >>= 1;
+    if (count > 0) {
+      step = multiplyMatrices(step, step);
+      orthonormalise(step);
+    }
+  }
+  return result;
+}
+
+// puts every node and the camera where the timeline has them at a frame, starting from where they are
+// in start ( a scene with the same nodes ). nothing depends on the frames drawn before, not even the
+// level of detail each model was last drawn with, so frames can be drawn in any order
+void Scene::pose(const Scene& start, const Timeline& timeline, int frame) {
+  for (int i = 0; i < nodes.size(); ++i) {
+    nodes[i].local = start.nodes[i].local;
+    nodes[i].dirty = true;
+    std::fill(nodes[i].cache.lodLevels.begin(), nodes[i].cache.lodLevels.end(), Renderer::LOD_UNKNOWN);
+  }
+  for (const NodeTrack& track : timeline.tracks) {
+    if (track.spin[0] != 0 || track.spin[1] != 0 || track.spin[2] != 0) {
+      SceneNode& node = nodes[track.node];
+      node.local = multiplyMatrices(getRepeatedRotation(track.spin, frame), node.local);
+      orthonormalise(node.local);
+    }
+    translateNode(track.node, track.velocity[0] * frame, track.velocity[1] * frame, track.velocity[2] * frame);
+  }
+  camera = start.camera;
+  for (int i = 0; i < 3; ++i) {
+    camera.position[i] += timeline.cameraVelocity[i] * frame;
+    camera.rotation[i] += timeline.cameraSpin[i] * frame;
+  }
+  lightSources = start.lightSources;
+}
+
+// the scene's own spins as a timeline, so a posed frame matches calling update that many times
+Timeline makeSpinTimeline(const Scene& scene, int frameCount) {
+  Timeline timeline;
+  timeline.frameCount = frameCount;
+  for (int i = 0; i < scene.nodes.size(); ++i) {
+    const std::array<float, 3>& spin = scene.nodes[i].spin;
+    if (spin[0] != 0 || spin[1] != 0 || spin[2] != 0) timeline.tracks.push_back(NodeTrack{ i, spin, { 0, 0, 0 } });
+  }
+  return timeline;
+}
+
+// works out the world transform of every node that changed, or whose parent moved, in one pass
+// since parents come first
+void Scene::updateTransforms() {
+  for (SceneNode& node : nodes) {
+    node.moved = node.dirty || (node.parent >= 0 && nodes[node.parent].moved);
+    if (!node.moved) continue;
+    node.world = node.parent >= 0 ? multiplyMatrices(nodes[node.parent].world, node.local) : node.local;
+    if (node.model >= 0) models[node.model].transform = node.world;
+    node.cache.cameraVersion = -1;
+    node.dirty = false;
+  }
+}
+
+// sets up the camera and submits every model, models that moved this frame don't keep their triangles.
+// with a bvh ( built over this scene ), it is refitted and models it finds outside the view are
+// counted as culled without being submitted
+void Scene::drawModels(Renderer& renderer, const Screen& screen, SceneBvh* bvh) {
+  updateTransforms();
+  renderer.setCamera(camera, lightSources, screen);
+  if (bvh) {
+    bvh->refit(*this);
+    bvh->queryFrustum(*this, renderer.getWorldFrustum());
+  }
+  for (int i = 0; i < nodes.size(); ++i) {
+    SceneNode& node = nodes[i];
+    if (bvh && !bvh->isNodeVisible(i)) {
+      if (node.model >= 0) renderer.countCulledMesh(models[node.model].mesh);
+      if (node.instanced >= 0) {
+        for (int j = 0; j < instancedModels[node.instanced].instances.size(); ++j) renderer.countCulledMesh(instancedModels[node.instanced].mesh);
+      }
+      continue;
+    }
+    DrawCache* cache = &node.cache;
+    cache->moving = node.moved;
+    if (node.model >= 0) renderer.drawMesh(models[node.model].mesh, models[node.model].transform, cache);
+    if (node.instanced >= 0) renderer.drawInstances(instancedModels[node.instanced].mesh, node.world, instancedModels[node.instanced].instances, cache);
+  }
+}
+
+// draws every model and fills the screen
+void Scene::draw(Renderer& renderer, Screen& screen, SceneBvh* bvh) {
+  drawModels(renderer, screen, bvh);
+  renderer.render(screen);
+}
+
+std::vector<char> defaultLetters = {'@', '%', '#', '*', '+', '=', '-', ':', '.'};
+// std::vector<char> letters = {'$', '@', 'B', '%', '8', '&', 'W', 'M', '#', '*', 'o', 'a', 'h', 'k', 'b', 'd', 'p', 'q', 'w', 'm', 'Z', 'O', '0', 'Q', 'L', 'C', 'J', 'U', 'Y', 'X', 'z', 'c', 'v', 'u', 'n', 'x', 'r', 'j', 'f', 't', '/', '\\', '|', '(', ')', '1', '{', '}', '[', ']', '?', '-', '_', '+', '~', '<', '>', 'i', '!', 'l', 'I', ';', ':', ',', '\"', '^', '`', '\'', '.'};
+static std::vector<std::string> rainbowColours = {"\033[31m", "\033[31m", "\033[32m", "\033[32m", "\033[33m", "\033[33m", "\033[34m", "\033[34m", "\033[35m", "\033[35m", "\033[36m", "\033[36m"};
+static std::vector<std::string> redColours = {"\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m", "\033[31m"};
+
+// the scene every scene below shares: camera position, lights
+static Scene makeEmptyScene() {
+  Scene scene;
+  scene.camera = { {0, -200, 0}, {0, 0, 0}, 100 };
+
+  std::array<float, 4> lightSource = { 0, -400, 0, 10 };
+  std::array<float, 4> lightSource2 = { 2000, 0, 0, 0 };
+  scene.lightSources = { lightSource, lightSource2 };
+  return scene;
+}
+
+// three cubes spinning around the origin
+Scene makeDemoScene() {
+  Scene scene = makeEmptyScene();
+
+  float sideLength = 20;
+  std::array<float, 3> centre = { -40, 0, 0 };
+  scene.addModel(makeCube(centre, sideLength, defaultLetters, rainbowColours), -1, { 0, 0, 0.04 });
+
+  sideLength = 30;
+  std::array<float, 3> centre2 = { 80, 0, 0 };
+  scene.addModel(makeCube(centre2, sideLength, defaultLetters, redColours), -1, { 0, 0.02, 0 });
+
+  sideLength = 25;
+  std::array<float, 3> centre3 = { 0, 60, 0 };
+  scene.addModel(makeCube(centre3, sideLength, defaultLetters, rainbowColours), -1, { 0.06, 0, 0 });
+
+  return scene;
+}
+
+// a cube right in front of the camera, slightly larger than what the screen can show
+Scene makeCloseUpScene() {
+  Scene scene = makeEmptyScene();
+  scene.addModel(makeCube({ 0, 0, 0 }, 30, defaultLetters, rainbowColours), -1, { 0.01, 0.007, 0.013 });
+  scene.camera.position = { 5, -45, 3 };
+  return scene;
+}
+
+// a grid of small cubes, thousands of triangles that each cover a few cells
+Scene makeManyCubesScene() {
+  Scene scene = makeEmptyScene();
+  for (int row = 0; row < 20; ++row) {
+    for (int column = 0; column < 32; ++column) {
+      std::array<float, 3> centre = { (column - 15.5f) * 10, 0, (row - 9.5f) * 6 };
+      scene.addModel(makeCube(centre, 2, defaultLetters, (row + column) % 2 ? rainbowColours : redColours), -1, { 0, 0.01, 0 });
+    }
+  }
+  return scene;
+}
+
+// the grid of small cubes standing still, with a pair of cubes circling a spinning hub in front of it
+Scene makeMostlyStaticScene() {
+  Scene scene = makeManyCubesScene();
+  for (SceneNode& node : scene.nodes) node.spin = { 0, 0, 0 };
+
+  Matrix hubPlace = getTranslationMatrix(0, -60, 0);
+  int hub = scene.addNode(-1, hubPlace, { 0, 0, 0.03 });
+  scene.addModel(makeCube({ 0, 0, 0 }, 5, defaultLetters, redColours), hub, { 0.05, 0, 0 });
+  int moon = scene.addModel(makeCube({ 0, 0, 0 }, 4, defaultLetters, rainbowColours), hub, { 0, 0.04, 0 });
+  scene.translateNode(moon, 35, 0, 0);
+  return scene;
+}
+
+// twenty thousand copies of one cube, each turned, sized and coloured on its own, slowly circling
+Scene makeInstancesScene() {
+  Scene scene = makeEmptyScene();
+  int node = scene.addInstancedModel(makeCube({ 0, 0, 0 }, 1, defaultLetters, rainbowColours).mesh, -1, { 0, 0, 0.005f });
+  std::vector<unsigned short> materials;
+  for (const std::string& colour : rainbowColours) materials.push_back(getMaterialId(defaultLetters, colour));
+
+  // a fixed sequence of numbers between 0 and 1, so every run draws the same scene
+  unsigned int seed = 12345;
+  auto random = [&]() {
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 8) / 16777216.0f;
+  };
+  std::vector<Instance>& instances = scene.instancedModels[scene.nodes[node].instanced].instances;
+  for (int i = 0; i < 20000; ++i) {
+    Matrix transform = getRotationMatrix(random() * 2 * PI, random() * 2 * PI, random() * 2 * PI);
+    float scale = 0.8f + random() * 1.2f;
+    for (int row = 0; row < 3; ++row) {
+      for (int column = 0; column < 3; ++column) transform[row][column] *= scale;
+    }
+    transform[0][3] = (random() - 0.5f) * 300;
+    transform[1][3] = random() * 300;
+    transform[2][3] = (random() - 0.5f) * 120;
+    instances.push_back(Instance{ transform, materials[i % materials.size()] });
+  }
+  return scene;
+}
+
+// one large mesh of about a quarter of a million triangles
+Scene makeLargeMeshScene() {
+  Scene scene = makeEmptyScene();
+  Model torus(makeTorus(70, 25, 512, 256, defaultLetters, "\033[36m"));
+  torus.rotate(0, 0, 1);
+  scene.addModel(std::move(torus), -1, { 0.01, 0, 0 });
+  return scene;
+}
+
+// a detailed torus copied from just in front of the camera to far away, so most copies cover only a
+// few cells and are drawn with one of its simpler versions
+Scene makeLodScene() {
+  Scene scene = makeEmptyScene();
+  Mesh torus = makeTorus(6, 2.5f, 96, 48, defaultLetters, "\033[36m");
+  torus.buildLods();
+  int node = scene.addInstancedModel(std::move(torus), -1, { 0, 0, 0.002f });
+  std::vector<unsigned short> materials;
+  for (const std::string& colour : rainbowColours) materials.push_back(getMaterialId(defaultLetters, colour));
+
+  std::vector<Instance>& instances = scene.instancedModels[scene.nodes[node].instanced].instances;
+  // rows further and further away, spread out to fill about the same part of the screen
+  for (int row = 0; row < 40; ++row) {
+    float depth = 40 + row * row;
+    for (int column = -5; column <= 5; ++column) {
+      Matrix transform = getRotationMatrix(row * 0.3f, column * 0.5f, 0);
+      transform[0][3] = column * depth * 0.3f;
+      transform[1][3] = depth - 200;
+      transform[2][3] = (row % 3 - 1) * depth * 0.1f;
+      instances.push_back(Instance{ transform, materials[(row + column + 5) % materials.size()] });
+    }
+  }
+  return scene;
+}
+
+// a loaded mesh, fitted to the view and slowly spinning
+Scene makeMeshScene(Mesh mesh) {
+  Scene scene = makeEmptyScene();
+  mesh.fit(80);
+  scene.addModel(Model(std::move(mesh)), -1, { 0.01, 0, 0 });
+  return scene;
+}
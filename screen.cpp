@@ -1,37 +1,40 @@
 #include "renderer.hpp"
 
+// escape codes of every colour in use, cells only store an index into this
+static std::vector<std::string> colourPalette = { "" };
+
+// finds (or adds) the palette index of a colour escape code
+unsigned char getColourIndex(std::string colour) {
+  for (int i = 0; i < colourPalette.size(); ++i) {
+    if (colourPalette[i] == colour) return i;
+  }
+  if (colourPalette.size() > std::numeric_limits<unsigned char>::max()) return 0;
+  colourPalette.push_back(colour);
+  return colourPalette.size() - 1;
+}
+
+const std::string& getColourCode(unsigned char index) {
+  return colourPalette[index];
+}
+
 // initialise buffer and zbuffer
 Screen::Screen(int w, int h) {
   width = w;
   height = h;
-  for (int i = 0; i < w * h; ++i) {
-    buffer.push_back(" ");
-    zBuffer.push_back(0);
-  }
+  buffer.assign(w * h, Cell{ ' ', 0 });
+  zBuffer.assign(w * h, 0);
+  tieBuffer.assign(w * h, 0);
 }
 
 // function to empty buffer width spaces (background char)
 void Screen::emptyBuffer() {
-  for (int i = 0; i < width * height; ++i) {
-    buffer[i] = " ";
-  }
+  std::fill(buffer.begin(), buffer.end(), Cell{ ' ', 0 });
 }
 
 // function to empty zbuffer (0 will be replaced by any positive ooz)
 void Screen::emptyZBuffer() {
-  for (int i = 0; i < width * height; ++i) {
-    zBuffer[i] = 0;
-  }
-}
-
-// draws the buffer to the screen
-void Screen::drawBuffer() {
-  for (int i = 0; i < width * height; ++i) {
-    std::cout << buffer[i];
-    if ((i + 1) % width == 0) {
-      std::cout << std::endl;
-    }
-  }
+  std::fill(zBuffer.begin(), zBuffer.end(), 0);
+  std::fill(tieBuffer.begin(), tieBuffer.end(), 0);
 }
 
 bool Screen::isInScreen(std::array<int, 2> vertex) {
@@ -39,22 +42,47 @@ bool Screen::isInScreen(std::array<int, 2> vertex) {
   else return true;
 }
 
-// Adds a point to the buffer depending on its ooz
-void Screen::addPoint(std::array<int, 2> point, float ooz /* one over z - for z-buffer */, char letter, std::string colour, float averageOoz) {
+// the rectangle of points that addPoint keeps
+ScreenRect Screen::getBounds() const {
+  return ScreenRect{ -width / 2, width - width / 2 - 1, height / 2 - height + 1, height / 2 };
+}
+
+// Adds a point to the buffer depending on its ooz, returns whether it was written. at equal ooz the
+// triangle nearer on average wins, so the result does not depend on the order triangles are filled in
+bool Screen::addPoint(std::array<int, 2> point, float ooz /* one over z - for z-buffer */, char letter, unsigned char colour, float averageOoz) {
   point[1] = -point[1]; // flipped y coord
   // moves the origin to the centre of the screen
   point[0] += (int)(width / 2);
   point[1] += (int)(height / 2);
   if (point[0] < width && point[0] >= 0 && point[1] >= 0 && point[1] < height) {
-    float currentOoz = zBuffer[width * point[1] + point[0]];
-    if (ooz > currentOoz) {
-      buffer[width * point[1] + point[0]] = colour + letter + "\033[0m";
-      zBuffer[width * point[1] + point[0]] = ooz;
-    } else if (ooz == currentOoz) {
-      if (averageOoz > currentOoz) {
-        buffer[width * point[1] + point[0]] = colour + letter + "\033[0m";
-        zBuffer[width * point[1] + point[0]] = ooz;
-      }
+    int index = width * point[1] + point[0];
+    float currentOoz = zBuffer[index];
+    if (ooz > currentOoz || (ooz == currentOoz && averageOoz > tieBuffer[index])) {
+      buffer[index] = Cell{ letter, colour };
+      zBuffer[index] = ooz;
+      tieBuffer[index] = averageOoz;
+      return true;
+    }
+  }
+  return false;
+}
+
+// fills the screen from one scale times smaller in each direction ( sized to cover all of it, as
+// Renderer does ), every cell of it becoming scale x scale cells here. both are centred on the origin
+void Screen::stretch(const Screen& smaller, int scale) {
+  for (int row = 0; row < height; ++row) {
+    int y = height / 2 - row;
+    int smallerY = y / scale - (y % scale != 0 && y < 0);
+    int smallerRow = std::max(0, std::min(smaller.height / 2 - smallerY, smaller.height - 1));
+    for (int column = 0; column < width; ++column) {
+      int x = column - width / 2;
+      int smallerX = x / scale - (x % scale != 0 && x < 0);
+      int smallerColumn = std::max(0, std::min(smallerX + smaller.width / 2, smaller.width - 1));
+      int from = smallerRow * smaller.width + smallerColumn;
+      int to = row * width + column;
+      buffer[to] = smaller.buffer[from];
+      zBuffer[to] = smaller.zBuffer[from];
+      tieBuffer[to] = smaller.tieBuffer[from];
     }
   }
 }
@@ -0,0 +1,266 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "renderer.hpp"
+
+// addresses are a tcp port on this machine ( "7000" or ":7000" ) or otherwise a unix socket path
+static bool getPort(const std::string& address, int& port) {
+  std::string digits = !address.empty() && address[0] == ':' ? address.substr(1) : address;
+  if (digits.empty() || digits.size() > 5) return false;
+  for (char c : digits) {
+    if (c < '0' || c > '9') return false;
+  }
+  port = std::stoi(digits);
+  return port > 0 && port < 65536;
+}
+
+static sockaddr_in getLoopbackAddress(int port) {
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  return address;
+}
+
+static bool getUnixAddress(const std::string& path, sockaddr_un& address) {
+  address = {};
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path)) return false;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+static void setNonBlocking(int socket) {
+  fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+}
+
+int connectToFrameServer(const std::string& address) {
+  int port;
+  int connection = -1;
+  if (getPort(address, port)) {
+    sockaddr_in tcpAddress = getLoopbackAddress(port);
+    connection = socket(AF_INET, SOCK_STREAM, 0);
+    if (connection >= 0 && connect(connection, (sockaddr*)&tcpAddress, sizeof(tcpAddress)) != 0) {
+      close(connection);
+      connection = -1;
+    }
+  } else {
+    sockaddr_un unixAddress;
+    if (!getUnixAddress(address, unixAddress)) return -1;
+    connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection >= 0 && connect(connection, (sockaddr*)&unixAddress, sizeof(unixAddress)) != 0) {
+      close(connection);
+      connection = -1;
+    }
+  }
+  return connection;
+}
+
+FrameServer::FrameServer() {
+  framesSinceKeyframe = 0;
+  listenSocket = -1;
+  wakePipe[0] = -1;
+  wakePipe[1] = -1;
+  stats = ServerStats{};
+  stopping = false;
+}
+
+FrameServer::~FrameServer() {
+  if (thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeThread();
+    thread.join();
+  }
+  for (Client& client : clients) close(client.socket);
+  if (listenSocket >= 0) close(listenSocket);
+  if (wakePipe[0] >= 0) close(wakePipe[0]);
+  if (wakePipe[1] >= 0) close(wakePipe[1]);
+  if (!socketPath.empty()) unlink(socketPath.c_str());
+}
+
+// starts accepting clients on a unix socket path, or a tcp port on the loopback address. a socket
+// left behind at the path by an earlier server is replaced
+bool FrameServer::listen(const std::string& address) {
+  if (listenSocket >= 0) return false;
+  int port;
+  if (getPort(address, port)) {
+    sockaddr_in tcpAddress = getLoopbackAddress(port);
+    listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    if (listenSocket >= 0) setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (listenSocket < 0 || bind(listenSocket, (sockaddr*)&tcpAddress, sizeof(tcpAddress)) != 0) {
+      if (listenSocket >= 0) close(listenSocket);
+      listenSocket = -1;
+      return false;
+    }
+  } else {
+    sockaddr_un unixAddress;
+    if (!getUnixAddress(address, unixAddress)) return false;
+    struct stat status;
+    if (stat(address.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) unlink(address.c_str());
+    listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenSocket < 0 || bind(listenSocket, (sockaddr*)&unixAddress, sizeof(unixAddress)) != 0) {
+      if (listenSocket >= 0) close(listenSocket);
+      listenSocket = -1;
+      return false;
+    }
+    socketPath = address;
+  }
+
+  if (::listen(listenSocket, 16) != 0 || pipe(wakePipe) != 0) {
+    close(listenSocket);
+    listenSocket = -1;
+    if (!socketPath.empty()) unlink(socketPath.c_str());
+    socketPath.clear();
+    return false;
+  }
+  setNonBlocking(listenSocket);
+  setNonBlocking(wakePipe[0]);
+  setNonBlocking(wakePipe[1]);
+  thread = std::thread(&FrameServer::serveLoop, this);
+  return true;
+}
+
+// encodes a frame once and queues it for every client. never waits on a client
+void FrameServer::broadcast(const Screen& screen) {
+  bool needKeyframe = framesSinceKeyframe >= keyframeInterval;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const Client& client : clients) needKeyframe = needKeyframe || client.waitingForKeyframe;
+  }
+
+  std::shared_ptr<const std::string> delta = std::make_shared<const std::string>(deltaEncoder.encode(screen));
+  std::shared_ptr<const std::string> keyframe;
+  if (needKeyframe) {
+    keyframeEncoder.reset();
+    keyframe = std::make_shared<const std::string>(keyframeEncoder.encode(screen));
+    framesSinceKeyframe = 0;
+  } else {
+    framesSinceKeyframe++;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (keyframe) stats.keyframes++;
+    for (Client& client : clients) {
+      if (!client.waitingForKeyframe && (int)client.queue.size() >= maxQueuedFrames) {
+        // a frame partly written has to be finished, or the terminal would be left mid escape code
+        int kept = client.sent > 0 ? 1 : 0;
+        stats.framesDropped += client.queue.size() - kept;
+        client.queue.resize(kept);
+        client.waitingForKeyframe = true;
+      }
+      if (client.waitingForKeyframe) {
+        if (!keyframe) continue;
+        client.queue.push_back(keyframe);
+        client.waitingForKeyframe = false;
+      } else {
+        client.queue.push_back(delta);
+      }
+      stats.framesQueued++;
+    }
+  }
+  wakeThread();
+}
+
+// makes the server thread look at the clients again without waiting for poll
+void FrameServer::wakeThread() {
+  char wake = 0;
+  ssize_t written = ::write(wakePipe[1], &wake, 1);
+  (void)written; // a full pipe already wakes it
+}
+
+// waits until every client has been sent everything queued for it, false if that takes too long
+bool FrameServer::waitUntilSent(int milliseconds) {
+  std::unique_lock<std::mutex> lock(mutex);
+  return sent.wait_for(lock, std::chrono::milliseconds(milliseconds), [&]() { return isIdle(); });
+}
+
+ServerStats FrameServer::getStats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  ServerStats current = stats;
+  current.clients = clients.size();
+  return current;
+}
+
+bool FrameServer::isIdle() {
+  for (const Client& client : clients) {
+    if (!client.queue.empty()) return false;
+  }
+  return true;
+}
+
+// accepts clients and writes to every one that can take more, until the server stops
+void FrameServer::serveLoop() {
+  std::vector<pollfd> polled;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (stopping) return;
+      polled.clear();
+      polled.push_back(pollfd{ wakePipe[0], POLLIN, 0 });
+      polled.push_back(pollfd{ listenSocket, POLLIN, 0 });
+      for (const Client& client : clients) {
+        polled.push_back(pollfd{ client.socket, (short)(client.queue.empty() ? POLLIN : POLLIN | POLLOUT), 0 });
+      }
+    }
+    if (poll(polled.data(), polled.size(), -1) < 0 && errno != EINTR) return;
+
+    char drained[64];
+    while (read(wakePipe[0], drained, sizeof(drained)) > 0) {}
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // only this thread adds or removes clients, so they still line up with polled
+    for (int i = clients.size() - 1; i >= 0; --i) {
+      short events = polled[i + 2].revents;
+      bool open = !(events & (POLLERR | POLLNVAL));
+      if (open && (events & (POLLIN | POLLHUP))) {
+        // clients never send anything, so readable means it hung up
+        char ignored[256];
+        ssize_t count = recv(clients[i].socket, ignored, sizeof(ignored), MSG_DONTWAIT);
+        open = count > 0 || (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+      }
+      if (open && (events & POLLOUT)) open = writeClient(clients[i]);
+      if (!open) {
+        close(clients[i].socket);
+        clients.erase(clients.begin() + i);
+      }
+    }
+
+    if (polled[1].revents & POLLIN) {
+      int socket;
+      while ((socket = accept(listenSocket, nullptr, nullptr)) >= 0) {
+        setNonBlocking(socket);
+        int noDelay = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        clients.push_back(Client{ socket, {}, 0, true });
+      }
+    }
+    if (isIdle()) sent.notify_all();
+  }
+}
+
+// writes as much of the client's queue as it takes without blocking, false once it has gone
+bool FrameServer::writeClient(Client& client) {
+  while (!client.queue.empty()) {
+    const std::string& frame = *client.queue.front();
+    ssize_t count = send(client.socket, frame.data() + client.sent, frame.size() - client.sent, MSG_NOSIGNAL);
+    if (count < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    client.sent += count;
+    if (client.sent < frame.size()) return true;
+    client.queue.pop_front();
+    client.sent = 0;
+  }
+  return true;
+}
@@ -0,0 +1,223 @@
+#include <map>
+#include <queue>
+
+#include "renderer.hpp"
+
+// the sum of squared distances to a set of planes, as the 10 distinct entries of a symmetric 4x4
+// matrix: aa ab ac ad bb bc bd cc cd dd
+struct Quadric {
+  std::array<double, 10> q = {};
+
+  void addPlane(double a, double b, double c, double d, double weight) {
+    q[0] += weight * a * a; q[1] += weight * a * b; q[2] += weight * a * c; q[3] += weight * a * d;
+    q[4] += weight * b * b; q[5] += weight * b * c; q[6] += weight * b * d;
+    q[7] += weight * c * c; q[8] += weight * c * d;
+    q[9] += weight * d * d;
+  }
+
+  void add(const Quadric& other) {
+    for (int i = 0; i < 10; ++i) q[i] += other.q[i];
+  }
+
+  double getError(const std::array<double, 3>& p) const {
+    double x = p[0], y = p[1], z = p[2];
+    return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+         + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+         + q[7] * z * z + 2 * q[8] * z + q[9];
+  }
+
+  // the point with the least error, false when the planes don't pin one down
+  bool getBestPoint(std::array<double, 3>& p) const {
+    double a = q[0], b = q[1], c = q[2], e = q[4], f = q[5], h = q[7];
+    double determinant = a * (e * h - f * f) - b * (b * h - f * c) + c * (b * f - e * c);
+    if (std::abs(determinant) < 1e-12) return false;
+    double x = -q[3], y = -q[6], z = -q[8];
+    p[0] = (x * (e * h - f * f) - b * (y * h - f * z) + c * (y * f - e * z)) / determinant;
+    p[1] = (a * (y * h - f * z) - x * (b * h - f * c) + c * (b * z - y * c)) / determinant;
+    p[2] = (a * (e * z - y * f) - b * (b * z - y * c) + x * (b * f - e * c)) / determinant;
+    return true;
+  }
+};
+
+// a possible collapse of the edge between two vertices, valid while neither has changed since
+struct EdgeCollapse {
+  double cost;
+  int a;
+  int b;
+  int versionA;
+  int versionB;
+  std::array<double, 3> target;
+
+  bool operator>(const EdgeCollapse& other) const { return cost > other.cost; }
+};
+
+// collapses the cheapest edges of a mesh ( by quadric error, garland and heckbert ) until it has at
+// most targetFaces faces, or no edge can go without folding a face over. open edges are held in place
+// by planes standing along them, so holes and outlines keep their shape.
+Mesh simplifyMesh(const Mesh& mesh, int targetFaces) {
+  int vertexCount = mesh.getVertexCount();
+  int faceCount = mesh.getFaceCount();
+  std::vector<std::array<double, 3>> positions(vertexCount);
+  for (int i = 0; i < vertexCount; ++i) positions[i] = { mesh.xs[i], mesh.ys[i], mesh.zs[i] };
+  std::vector<std::array<int, 3>> faces(faceCount);
+  for (int face = 0; face < faceCount; ++face) faces[face] = { mesh.indices[face * 3], mesh.indices[face * 3 + 1], mesh.indices[face * 3 + 2] };
+
+  std::vector<std::vector<int>> vertexFaces(vertexCount);
+  std::vector<Quadric> quadrics(vertexCount);
+  std::vector<bool> faceRemoved(faceCount, false);
+  std::vector<bool> vertexRemoved(vertexCount, false);
+  std::vector<int> versions(vertexCount, 0);
+
+  auto getNormal = [&](const std::array<int, 3>& corners, std::array<double, 3>& normal) {
+    const std::array<double, 3>& p0 = positions[corners[0]];
+    const std::array<double, 3>& p1 = positions[corners[1]];
+    const std::array<double, 3>& p2 = positions[corners[2]];
+    std::array<double, 3> ab = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    std::array<double, 3> ac = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    normal = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+    return std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+  };
+
+  // every face's plane, weighted by its area, goes into the quadrics of its corners
+  std::map<std::pair<int, int>, int> edgeFaces; // how many faces share each edge
+  for (int face = 0; face < faceCount; ++face) {
+    std::array<double, 3> normal;
+    double length = getNormal(faces[face], normal);
+    for (int j = 0; j < 3; ++j) {
+      int corner = faces[face][j];
+      vertexFaces[corner].push_back(face);
+      int next = faces[face][(j + 1) % 3];
+      edgeFaces[{ std::min(corner, next), std::max(corner, next) }]++;
+    }
+    if (length == 0) continue;
+    for (int j = 0; j < 3; ++j) normal[j] /= length;
+    const std::array<double, 3>& p = positions[faces[face][0]];
+    double d = -(normal[0] * p[0] + normal[1] * p[1] + normal[2] * p[2]);
+    for (int corner : faces[face]) quadrics[corner].addPlane(normal[0], normal[1], normal[2], d, length / 2);
+  }
+
+  // a heavily weighted plane through each open edge, at right angles to its face
+  for (int face = 0; face < faceCount; ++face) {
+    std::array<double, 3> normal;
+    if (getNormal(faces[face], normal) == 0) continue;
+    for (int j = 0; j < 3; ++j) {
+      int a = faces[face][j], b = faces[face][(j + 1) % 3];
+      if (edgeFaces[{ std::min(a, b), std::max(a, b) }] != 1) continue;
+      std::array<double, 3> edge = { positions[b][0] - positions[a][0], positions[b][1] - positions[a][1], positions[b][2] - positions[a][2] };
+      std::array<double, 3> side = { edge[1] * normal[2] - edge[2] * normal[1], edge[2] * normal[0] - edge[0] * normal[2], edge[0] * normal[1] - edge[1] * normal[0] };
+      double length = std::sqrt(side[0] * side[0] + side[1] * side[1] + side[2] * side[2]);
+      if (length == 0) continue;
+      for (int k = 0; k < 3; ++k) side[k] /= length;
+      double d = -(side[0] * positions[a][0] + side[1] * positions[a][1] + side[2] * positions[a][2]);
+      double weight = 1000 * (edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+      quadrics[a].addPlane(side[0], side[1], side[2], d, weight);
+      quadrics[b].addPlane(side[0], side[1], side[2], d, weight);
+    }
+  }
+
+  auto makeCollapse = [&](int a, int b) {
+    Quadric sum = quadrics[a];
+    sum.add(quadrics[b]);
+    EdgeCollapse collapse = { 0, a, b, versions[a], versions[b], {} };
+    if (!sum.getBestPoint(collapse.target)) {
+      // fall back to whichever of the ends and the middle is best
+      std::array<double, 3> middle = { (positions[a][0] + positions[b][0]) / 2, (positions[a][1] + positions[b][1]) / 2, (positions[a][2] + positions[b][2]) / 2 };
+      collapse.target = middle;
+      for (const std::array<double, 3>& candidate : { positions[a], positions[b] }) {
+        if (sum.getError(candidate) < sum.getError(collapse.target)) collapse.target = candidate;
+      }
+    }
+    collapse.cost = std::max(0.0, sum.getError(collapse.target));
+    return collapse;
+  };
+
+  std::priority_queue<EdgeCollapse, std::vector<EdgeCollapse>, std::greater<EdgeCollapse>> queue;
+  for (const auto& edge : edgeFaces) queue.push(makeCollapse(edge.first.first, edge.first.second));
+
+  // moving a vertex to target must not turn any of its faces ( other than ones on the edge ) over
+  auto keepsFacing = [&](int moved, int other, const std::array<double, 3>& target) {
+    for (int face : vertexFaces[moved]) {
+      if (faceRemoved[face]) continue;
+      std::array<int, 3> corners = faces[face];
+      if (corners[0] == other || corners[1] == other || corners[2] == other) continue;
+      std::array<double, 3> before, after;
+      if (getNormal(corners, before) == 0) continue;
+      std::array<double, 3> saved = positions[moved];
+      positions[moved] = target;
+      double length = getNormal(corners, after);
+      positions[moved] = saved;
+      if (length == 0 || before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0) return false;
+    }
+    return true;
+  };
+
+  int faceTotal = faceCount;
+  while (faceTotal > targetFaces && !queue.empty()) {
+    EdgeCollapse collapse = queue.top();
+    queue.pop();
+    int a = collapse.a, b = collapse.b;
+    if (vertexRemoved[a] || vertexRemoved[b] || versions[a] != collapse.versionA || versions[b] != collapse.versionB) continue;
+    if (!keepsFacing(a, b, collapse.target) || !keepsFacing(b, a, collapse.target)) continue;
+
+    // b joins a: faces on the edge go, the rest of b's faces move over to a
+    positions[a] = collapse.target;
+    quadrics[a].add(quadrics[b]);
+    vertexRemoved[b] = true;
+    for (int face : vertexFaces[b]) {
+      if (faceRemoved[face]) continue;
+      std::array<int, 3>& corners = faces[face];
+      if (corners[0] == a || corners[1] == a || corners[2] == a) {
+        faceRemoved[face] = true;
+        faceTotal--;
+        continue;
+      }
+      for (int& corner : corners) {
+        if (corner == b) corner = a;
+      }
+      vertexFaces[a].push_back(face);
+    }
+    vertexFaces[b].clear();
+
+    // forget removed faces, then offer every edge around a again
+    std::vector<int>& around = vertexFaces[a];
+    around.erase(std::remove_if(around.begin(), around.end(), [&](int face) { return faceRemoved[face]; }), around.end());
+    versions[a]++;
+    for (int face : around) {
+      for (int corner : faces[face]) {
+        if (corner != a) queue.push(makeCollapse(a, corner));
+      }
+    }
+  }
+
+  // keep only the vertices still in use, in their old order
+  Mesh simplified;
+  std::vector<int> newIndices(vertexCount, -1);
+  for (int face = 0; face < faceCount; ++face) {
+    if (faceRemoved[face]) continue;
+    std::array<int, 3> corners;
+    for (int j = 0; j < 3; ++j) {
+      int vertex = faces[face][j];
+      if (newIndices[vertex] < 0) newIndices[vertex] = simplified.addVertex({ (float)positions[vertex][0], (float)positions[vertex][1], (float)positions[vertex][2] });
+      corners[j] = newIndices[vertex];
+    }
+    simplified.addFace(corners[0], corners[1], corners[2], mesh.faceMaterials[face]);
+  }
+  simplified.closed = mesh.closed;
+  simplified.smooth = mesh.smooth;
+  simplified.updateBounds();
+  simplified.updateNormals();
+  return simplified;
+}
+
+// builds the chain of simpler versions of the mesh drawn when it is small on the screen, each with
+// about half the faces of the one before, down to around minFaces
+void Mesh::buildLods(int minFaces) {
+  lods.clear();
+  const Mesh* previous = this;
+  while (previous->getFaceCount() / 2 >= minFaces) {
+    Mesh simplified = simplifyMesh(*previous, previous->getFaceCount() / 2);
+    if (simplified.getFaceCount() > previous->getFaceCount() * 3 / 4) break; // nothing much left to collapse
+    lods.push_back(std::move(simplified));
+    previous = &lods.back();
+  }
+}
@@ -0,0 +1,92 @@
+#include "renderer.hpp"
+
+WorkerPool::WorkerPool(int threadCount) {
+  taskFunction = nullptr;
+  taskContext = nullptr;
+  taskCount = 0;
+  nextTask = 0;
+  busyWorkers = 0;
+  generation = 0;
+  stopping = false;
+  startThreads(threadCount);
+}
+
+WorkerPool::~WorkerPool() {
+  stopThreads();
+}
+
+int WorkerPool::getThreadCount() {
+  return threads.size() + 1;
+}
+
+void WorkerPool::setThreadCount(int threadCount) {
+  stopThreads();
+  startThreads(threadCount);
+}
+
+void WorkerPool::startThreads(int threadCount) {
+  stopping = false;
+  for (int worker = 1; worker < threadCount; ++worker) {
+    threads.emplace_back(&WorkerPool::workerLoop, this, worker, generation);
+  }
+}
+
+void WorkerPool::stopThreads() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread& thread : threads) thread.join();
+  threads.clear();
+}
+
+// seenGeneration is passed in so that a run started before the thread gets going is not missed
+void WorkerPool::workerLoop(int worker, int seenGeneration) {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+      if (stopping) return;
+      seenGeneration = generation;
+    }
+
+    doTasks(worker);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    busyWorkers--;
+    if (busyWorkers == 0) finished.notify_all();
+  }
+}
+
+void WorkerPool::runTasks(int count, void (*function)(void*, int, int), void* context) {
+  if (threads.empty() || count <= 1) {
+    for (int task = 0; task < count; ++task) function(context, task, 0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    taskFunction = function;
+    taskContext = context;
+    taskCount = count;
+    nextTask = 0;
+    busyWorkers = threads.size();
+    generation++;
+  }
+  wake.notify_all();
+
+  doTasks(0);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [&] { return busyWorkers == 0; });
+}
+
+// takes tasks until there are none left
+void WorkerPool::doTasks(int worker) {
+  while (true) {
+    int task = nextTask.fetch_add(1);
+    if (task >= taskCount) return;
+    taskFunction(taskContext, task, worker);
+  }
+}